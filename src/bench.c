@@ -7,16 +7,31 @@
 #include "makemove.h"
 #include "move.h"
 #include "movegen.h"
+#include "movepicker.h"
 #include "timeman.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_UNIT "cycles"
+static inline unsigned long long readCycles() { return __rdtsc(); }
+#else
+// No cycle counter, so fall back to nanoseconds
+#define CYCLE_UNIT "ns"
+static inline unsigned long long readCycles() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
 U64 perft(Board *board, int depth) {
     // leaf node reached
     if (depth == 0)
         return 1ULL;
 
-    // get all pseudolegal moves
+    // get all legal moves
     MoveList moves;
-    generatePseudoLegalMoves(&moves, board);
+    generateLegalMoves(&moves, board);
 
     U64 nodes = 0;
 
@@ -24,11 +39,7 @@ U64 perft(Board *board, int depth) {
     for (int i = 0; i < moves.count; i++) {
         Move move = moves.list[i];
 
-        // Skip illegal moves
-        if (makeMove(board, move) == 0) {
-            undoMove(board, move);
-            continue;
-        }
+        makeMove(board, move);
         nodes += perft(board, depth - 1);
         undoMove(board, move);
     }
@@ -89,4 +100,130 @@ void bench(Board *board, int depth) {
     double nodesPerSecond =
             (double)nodes / ((double)msElapsed / 1000.0) / 1000000.0;
     printf("Meganodes per second: %.2lf\n", nodesPerSecond);
-}
\ No newline at end of file
+}
+
+// The heap the move picker used to keep, parallel move and score arrays
+// Only kept around as the baseline for benchMovePicker()
+static void heapify(int *scores, Move *moves, int n, int i) {
+    int largest = i;
+    int left = 2 * i + 1;
+    int right = 2 * i + 2;
+
+    if (left < n && scores[left] > scores[largest])
+        largest = left;
+    if (right < n && scores[right] > scores[largest])
+        largest = right;
+
+    if (largest != i) {
+        int tempScore = scores[i];
+        scores[i] = scores[largest];
+        scores[largest] = tempScore;
+
+        Move tempMove = moves[i];
+        moves[i] = moves[largest];
+        moves[largest] = tempMove;
+
+        heapify(scores, moves, n, largest);
+    }
+}
+
+static Move heapPicks(Move *list, int *listScores, int count, int picks) {
+    Move moves[MAX_LEGAL_MOVES];
+    int scores[MAX_LEGAL_MOVES];
+    Move checksum = 0;
+
+    for (int i = 0; i < count; i++) {
+        moves[i] = list[i];
+        scores[i] = listScores[i];
+    }
+    for (int i = count / 2 - 1; i >= 0; i--)
+        heapify(scores, moves, count, i);
+
+    for (int i = 0; i < picks; i++) {
+        checksum ^= moves[0];
+        count--;
+        moves[0] = moves[count];
+        scores[0] = scores[count];
+        heapify(scores, moves, count, 0);
+    }
+    return checksum;
+}
+
+static Move rangePicks(Move *list, int *listScores, int count, int picks) {
+    ScoredMove moves[MAX_LEGAL_MOVES];
+    MoveRange range;
+    Move checksum = 0;
+
+    for (int i = 0; i < count; i++)
+        moves[i] = MakeScoredMove(list[i], listScores[i]);
+    initMoveRange(&range, 0, count);
+
+    for (int i = 0; i < picks; i++)
+        checksum ^= ScoredMoveMove(takeFromRange(moves, &range, bestInRange(moves, &range)));
+    return checksum;
+}
+
+// Measures the cost of picking moves out of the list with the old heap and
+// with the packed selection/insertion range the picker uses now
+// Scores are random in the quiet history range, which is the worst case for
+// both since nothing is presorted
+void benchMovePicker() {
+    char *fens[] = {
+        START_FEN,
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2q1rk1/pp2bppp/2n1bn2/3p4/3P4/2NBPN2/PP3PPP/R1BQ1RK1 w - - 0 10",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    };
+    int nbFens = sizeof(fens) / sizeof(fens[0]);
+    int pickCounts[] = {1, 3, 8, MAX_LEGAL_MOVES};
+    const int repeats = 200000;
+
+    Board board;
+    MoveList lists[4];
+    int scores[4][MAX_LEGAL_MOVES];
+
+    unsigned seed = 1;
+    for (int i = 0; i < nbFens; i++) {
+        parseFen(&board, fens[i]);
+        generateLegalMoves(&lists[i], &board);
+        for (int j = 0; j < lists[i].count; j++) {
+            seed = seed * 1103515245 + 12345;
+            scores[i][j] = (seed >> 16) % MAX_HISTORY_SCORE;
+        }
+    }
+
+    printf("%-8s %14s %14s\n", "picks", "heap", "range");
+
+    unsigned long checksum = 0;
+    for (int p = 0; p < 4; p++) {
+        unsigned long long heapCycles = 0, rangeCycles = 0;
+        long picked = 0;
+
+        for (int i = 0; i < nbFens; i++) {
+            int picks = MIN(pickCounts[p], lists[i].count);
+            picked += (long)picks * repeats;
+
+            unsigned long long start = readCycles();
+            for (int r = 0; r < repeats; r++)
+                checksum += heapPicks(lists[i].list, scores[i], lists[i].count, picks);
+            heapCycles += readCycles() - start;
+
+            start = readCycles();
+            for (int r = 0; r < repeats; r++)
+                checksum += rangePicks(lists[i].list, scores[i], lists[i].count, picks);
+            rangeCycles += readCycles() - start;
+        }
+
+        char label[16];
+        if (pickCounts[p] == MAX_LEGAL_MOVES)
+            sprintf(label, "all");
+        else
+            sprintf(label, "%d", pickCounts[p]);
+
+        printf("%-8s %8.1f %s %8.1f %s\n", label,
+               (double)heapCycles / picked, CYCLE_UNIT, (double)rangeCycles / picked, CYCLE_UNIT);
+    }
+
+    // Keeps the picks from being optimised out
+    printf("(checksum %lu)\n", checksum);
+}
@@ -4,3 +4,4 @@
 
 int startPerft(char *FEN, int depth);
 void bench(Board *board, int depth);
+void benchMovePicker();
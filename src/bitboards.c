@@ -10,6 +10,11 @@ U64 knightMasks[64];
 U64 kingMasks[64];
 U64 pawnMasks[2][64];
 
+// Squares strictly between two aligned squares, and the whole line through
+// them (empty when they aren't on the same rank, file or diagonal)
+U64 betweenMasks[64][64];
+U64 lineMasks[64][64];
+
 // bitboard operations
 int getlsb(U64 bitboard) { return __builtin_ctzll(bitboard); }
 
@@ -35,6 +40,30 @@ int popCount(U64 bitboard) { return __builtin_popcountll(bitboard); }
 
 bool testBit(U64 bitboard, int sq) { return bitboard & (1ULL << sq); }
 
+// Setwise operations
+// Shifts one file sideways, dropping whatever falls off the board
+U64 shiftEast(U64 bitboard) { return (bitboard << 1) & ~FILE_A_MASK; }
+
+U64 shiftWest(U64 bitboard) { return (bitboard >> 1) & ~FILE_H_MASK; }
+
+// Smears every bit up or down its file, the bits themselves included
+U64 northFill(U64 bitboard) {
+    bitboard |= bitboard << 8;
+    bitboard |= bitboard << 16;
+    bitboard |= bitboard << 32;
+    return bitboard;
+}
+
+U64 southFill(U64 bitboard) {
+    bitboard |= bitboard >> 8;
+    bitboard |= bitboard >> 16;
+    bitboard |= bitboard >> 32;
+    return bitboard;
+}
+
+// Every square of every file with a bit on it
+U64 fileFill(U64 bitboard) { return northFill(bitboard) | southFill(bitboard); }
+
 // Displays bitboard w/ chess coordinates
 // Set bits are marked 'X'
 void printBitboard(U64 bitboard) {
@@ -127,6 +156,40 @@ U64 createPawnMask(int color, int sq) {
     return mask;
 }
 
+// Walks every ray from sq, filling in the between and line masks of each
+// square it passes
+void createLineMasks(int sq) {
+    const int DIRECTIONS[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1},
+                                  { 0,  1}, { 1, -1}, { 1, 0}, {1,  1}};
+
+    for (int dir = 0; dir < 8; ++dir) {
+        // The full line is this ray, the opposite ray and sq itself
+        U64 line = 1ULL << sq;
+        for (int sign = -1; sign <= 1; sign += 2) {
+            int file = fileOf(sq) + sign * DIRECTIONS[dir][1];
+            int rank = rankOf(sq) + sign * DIRECTIONS[dir][0];
+            while (fileRankInBoard(file, rank)) {
+                setBit(&line, squareFrom(file, rank));
+                file += sign * DIRECTIONS[dir][1];
+                rank += sign * DIRECTIONS[dir][0];
+            }
+        }
+
+        U64 between = 0ULL;
+        int file = fileOf(sq) + DIRECTIONS[dir][1];
+        int rank = rankOf(sq) + DIRECTIONS[dir][0];
+        while (fileRankInBoard(file, rank)) {
+            int to = squareFrom(file, rank);
+            betweenMasks[sq][to] = between;
+            lineMasks[sq][to] = line;
+
+            setBit(&between, to);
+            file += DIRECTIONS[dir][1];
+            rank += DIRECTIONS[dir][0];
+        }
+    }
+}
+
 // initialises attack masks for Kings, Knights and Pawns
 void initAttackMasks() {
     for (int sq = 0; sq < 64; ++sq) {
@@ -135,6 +198,8 @@ void initAttackMasks() {
 
         pawnMasks[WHITE][sq] = createPawnMask(WHITE, sq);
         pawnMasks[BLACK][sq] = createPawnMask(BLACK, sq);
+
+        createLineMasks(sq);
     }
 }
 
@@ -143,4 +208,8 @@ U64 knightAttacks(int sq) { return knightMasks[sq]; }
 
 U64 kingAttacks(int sq) { return kingMasks[sq]; }
 
-U64 pawnAttacks(int color, int sq) { return pawnMasks[color][sq]; }
\ No newline at end of file
+U64 pawnAttacks(int color, int sq) { return pawnMasks[color][sq]; }
+
+U64 squaresBetween(int sq1, int sq2) { return betweenMasks[sq1][sq2]; }
+
+U64 lineThrough(int sq1, int sq2) { return lineMasks[sq1][sq2]; }
\ No newline at end of file
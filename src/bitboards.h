@@ -18,6 +18,16 @@ void setBit(U64 *bitboard, int sq);
 void clearBit(U64 *bitboard, int sq);
 bool testBit(U64 bitboard, int sq);
 
+// Setwise operations
+#define FILE_A_MASK C64(0x0101010101010101)
+#define FILE_H_MASK C64(0x8080808080808080)
+
+U64 shiftEast(U64 bitboard);
+U64 shiftWest(U64 bitboard);
+U64 northFill(U64 bitboard);
+U64 southFill(U64 bitboard);
+U64 fileFill(U64 bitboard);
+
 // Helper functions for IO
 void printBitboard(U64 bitboard);
 int squareFrom(int file, int rank);
@@ -29,3 +39,7 @@ void initAttackMasks();
 U64 knightAttacks(int sq);
 U64 kingAttacks(int sq);
 U64 pawnAttacks(int color, int sq);
+
+// Lines between squares, empty if the squares aren't aligned
+U64 squaresBetween(int sq1, int sq2);
+U64 lineThrough(int sq1, int sq2);
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "eval.h"
 #include "magicmoves.h"
 #include "zobrist.h"
 
@@ -53,10 +54,14 @@ void clearBoard(Board *board) {
     // Clear board variables
     board->side = BOTH;
     board->hash = 0ULL;
+    board->pawnHash = 0ULL;
     board->epSquare = NO_SQ;
     board->fiftyMove = 0;
     board->castlePerm = 0;
     board->ply = 0;
+    board->fullMoves = 1;
+    board->materialPSQT = 0;
+    board->phase = 0;
 
     // Clear history
     for (int i = 0; i < MAX_MOVES; i++) {
@@ -68,6 +73,12 @@ void clearBoard(Board *board) {
         undo.movedPiece = NO_PIECE;
         undo.capturedPiece = NO_PIECE;
     }
+
+    // Forget any attack info or accumulators from the old position
+    for (int i = 0; i < ATTACK_INFO_SLOTS; i++)
+        board->attackInfo[i].hash = 0ULL;
+    for (int i = 0; i < ACCUMULATOR_SLOTS; i++)
+        board->accumulators[i].hash = 0ULL;
 }
 
 // Sets a piece on the board at the square
@@ -87,6 +98,12 @@ void setPiece(Board *board, int color, int piece, int sq) {
 
     // Update board hash
     board->hash ^= PieceKeys[toPiece(piece, color)][sq];
+    if (piece == PAWN)
+        board->pawnHash ^= PieceKeys[toPiece(piece, color)][sq];
+
+    // Update evaluation sums
+    board->materialPSQT += PSQTScores[toPiece(piece, color)][sq];
+    board->phase += PhaseValues[piece];
 }
 
 // Clears the piece from the board on the square specified
@@ -107,6 +124,12 @@ void clearPiece(Board *board, int color, int sq) {
 
     // Update board hash
     board->hash ^= PieceKeys[toPiece(piece, color)][sq];
+    if (piece == PAWN)
+        board->pawnHash ^= PieceKeys[toPiece(piece, color)][sq];
+
+    // Update evaluation sums
+    board->materialPSQT -= PSQTScores[toPiece(piece, color)][sq];
+    board->phase -= PhaseValues[piece];
 }
 
 // Moves piece from one square to on board
@@ -138,6 +161,14 @@ void movePiece(Board *board, int from, int to, int color) {
     // Update board hash
     board->hash ^= PieceKeys[toPiece(piece, color)][from];
     board->hash ^= PieceKeys[toPiece(piece, color)][to];
+    if (piece == PAWN) {
+        board->pawnHash ^= PieceKeys[toPiece(piece, color)][from];
+        board->pawnHash ^= PieceKeys[toPiece(piece, color)][to];
+    }
+
+    // Update evaluation sums, the phase stays the same
+    board->materialPSQT += PSQTScores[toPiece(piece, color)][to]
+                         - PSQTScores[toPiece(piece, color)][from];
 }
 
 // If we're in a pawn endgame we don't try null move
@@ -219,6 +250,96 @@ U64 attackersToKingSquare(Board *board) {
          board->colors[!board->side];
 }
 
+// Squares attacked by a piece on sq
+static inline U64 pieceAttacks(int color, int piece, int sq, U64 occupied) {
+    switch (piece) {
+    case PAWN:
+        return pawnAttacks(color, sq);
+    case KNIGHT:
+        return knightAttacks(sq);
+    case BISHOP:
+        return Bmagic(sq, occupied);
+    case ROOK:
+        return Rmagic(sq, occupied);
+    case QUEEN:
+        return Bmagic(sq, occupied) | Rmagic(sq, occupied);
+    default:
+        return kingAttacks(sq);
+    }
+}
+
+static void computeAttackInfo(Board *board, AttackInfo *info) {
+    U64 occupied = board->colors[BOTH];
+    U64 ours = board->colors[board->side];
+    U64 theirs = board->colors[!board->side];
+
+    // King zones, with an extra rank in front of each king since that's
+    // where the attacks come from
+    for (int color = WHITE; color <= BLACK; color++) {
+        U64 king = board->pieces[KING] & board->colors[color];
+        U64 zone = king | kingAttacks(getlsb(king));
+        info->kingZone[color] = zone | (color == WHITE ? zone << 8 : zone >> 8);
+    }
+
+    for (int color = WHITE; color <= BLACK; color++) {
+        info->attacked[color] = 0ULL;
+
+        for (int piece = PAWN; piece <= KING; piece++) {
+            U64 pieces = board->pieces[piece] & board->colors[color];
+            U64 attackedBy = 0ULL;
+            int mobility = 0, kingAttacks = 0;
+
+            while (pieces) {
+                U64 attacks = pieceAttacks(color, piece, poplsb(&pieces), occupied);
+                attackedBy |= attacks;
+                mobility += popCount(attacks & ~board->colors[color]);
+                kingAttacks += popCount(attacks & info->kingZone[!color]);
+            }
+
+            info->attackedBy[color][piece] = attackedBy;
+            info->attacked[color] |= attackedBy;
+            info->mobility[color][piece] = mobility;
+            info->kingAttacks[color][piece] = kingAttacks;
+        }
+    }
+
+    int kingSq = getlsb(board->pieces[KING] & ours);
+    info->checkers = allAttackersToSquare(board, occupied, kingSq) & theirs;
+
+    // Their sliders which would see our king if our own pieces weren't there
+    // If exactly one of our pieces is in the way, that piece is pinned
+    U64 snipers = (Rmagic(kingSq, theirs) & (board->pieces[ROOK] | board->pieces[QUEEN]))
+                | (Bmagic(kingSq, theirs) & (board->pieces[BISHOP] | board->pieces[QUEEN]));
+    snipers &= theirs;
+
+    info->pinned = 0ULL;
+    while (snipers) {
+        int sniper = poplsb(&snipers);
+        U64 blockers = squaresBetween(kingSq, sniper) & occupied;
+        if (popCount(blockers) == 1)
+            info->pinned |= blockers & ours;
+    }
+
+    info->hash = board->hash;
+}
+
+// Attack info for the current position
+// Only computed the first time it's asked for at a node, after that every
+// user at the node gets the same copy
+AttackInfo *getAttackInfo(Board *board) {
+    AttackInfo *info = &board->attackInfo[board->ply & (ATTACK_INFO_SLOTS - 1)];
+    if (info->hash != board->hash)
+        computeAttackInfo(board, info);
+    return info;
+}
+
+// Attack info for the current position if something has already asked for
+// it at this node, NULL otherwise
+AttackInfo *cachedAttackInfo(Board *board) {
+    AttackInfo *info = &board->attackInfo[board->ply & (ATTACK_INFO_SLOTS - 1)];
+    return (info->hash == board->hash) ? info : NULL;
+}
+
 // Static Exchange Evaluation
 const int SEEPieceValues[NB_PIECES] = {100, 320, 320, 500, 950, 100000};
 
@@ -248,6 +369,18 @@ int SEE(Board *board, Move move, int threshold) {
     if (evaluation >= 0)
         return true;
 
+    // If this node's attack maps are already built they can usually answer
+    // without finding the attackers: nobody can recapture if they don't
+    // attack the square yet and none of their sliders on the line through
+    // our piece could be uncovered by it moving
+    AttackInfo *info = cachedAttackInfo(board);
+    if (info != NULL && !testBit(info->attacked[!board->side], exchangeSquare)) {
+        bool straight = fileOf(from) == fileOf(exchangeSquare) || rankOf(from) == rankOf(exchangeSquare);
+        U64 sliders = board->pieces[QUEEN] | board->pieces[straight ? ROOK : BISHOP];
+        if (!(lineThrough(from, exchangeSquare) & sliders & board->colors[!board->side]))
+            return true;
+    }
+
     // Opponent to move next
     sideToCapture = !board->side;
 
@@ -362,6 +495,10 @@ void printBoard(Board *board) {
 
     // print half moves
     printf("Half moves: %d\n", board->ply);
+
+    char fen[128];
+    boardToFen(board, fen);
+    printf("Fen: %s\n", fen);
 }
 
 // Sets a provided board to the provided FEN
@@ -482,11 +619,71 @@ void parseFen(Board *board, char *fen) {
     board->fiftyMove = strtol(fen, &fen, 10);
     fen++;
 
-    // We ignore the move counter because this is root to our chess engine anyways
+    // Kept for writing FENs back out, the search counts plies from here
     int fullMoves = strtol(fen, &fen, 10);
+    board->fullMoves = MAX(1, fullMoves);
     board->ply = 0;
 
-    // Reset the Zobrist hash
+    // Reset the Zobrist hashes
     board->hash = generateHash(board);
+    board->pawnHash = generatePawnHash(board);
     assert(board->hash == generateHash(board));
 }
+
+// Full move number of the current position, counting on from the FEN
+int fullMoveNumber(Board *board) {
+    int rootSide = board->side ^ (board->ply & 1);
+    return board->fullMoves + (board->ply + (rootSide == BLACK)) / 2;
+}
+
+// Writes the board as a FEN into fen, which needs room for 90 characters
+void boardToFen(Board *board, char *fen) {
+    const char asciiPieces[12] = "PNBRQKpnbrqk";
+
+    for (int rank = 7; rank >= 0; rank--) {
+        int empty = 0;
+        for (int file = 0; file < 8; file++) {
+            int sq = squareFrom(file, rank);
+            if (board->squares[sq] == EMPTY) {
+                empty++;
+                continue;
+            }
+
+            if (empty) {
+                *fen++ = '0' + empty;
+                empty = 0;
+            }
+            int color = testBit(board->colors[WHITE], sq) ? WHITE : BLACK;
+            *fen++ = asciiPieces[toPiece(board->squares[sq], color)];
+        }
+        if (empty)
+            *fen++ = '0' + empty;
+        if (rank > 0)
+            *fen++ = '/';
+    }
+
+    *fen++ = ' ';
+    *fen++ = (board->side == WHITE) ? 'w' : 'b';
+    *fen++ = ' ';
+
+    if (board->castlePerm == 0)
+        *fen++ = '-';
+    if (board->castlePerm & CASTLE_WK)
+        *fen++ = 'K';
+    if (board->castlePerm & CASTLE_WQ)
+        *fen++ = 'Q';
+    if (board->castlePerm & CASTLE_BK)
+        *fen++ = 'k';
+    if (board->castlePerm & CASTLE_BQ)
+        *fen++ = 'q';
+    *fen++ = ' ';
+
+    if (board->epSquare != NO_SQ) {
+        *fen++ = 'a' + fileOf(board->epSquare);
+        *fen++ = '1' + rankOf(board->epSquare);
+    } else {
+        *fen++ = '-';
+    }
+
+    sprintf(fen, " %d %d", board->fiftyMove, fullMoveNumber(board));
+}
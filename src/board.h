@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "bitboards.h"
 #include "move.h"
@@ -69,8 +70,45 @@ typedef struct {
     Move move;
 
     U64 hash;
+    U64 pawnHash;
+
+    int materialPSQT;
+    int phase;
 } Undo;
 
+// Attack information about a position
+// Computed at most once per node by getAttackInfo() and shared by the
+// evaluation, the move generators and SEE
+typedef struct {
+    U64 hash;                      // Position this was computed for
+
+    U64 attackedBy[2][NB_PIECES];  // Squares attacked by each piece type of each side
+    U64 attacked[2];               // Squares attacked by each side
+    U64 kingZone[2];               // Each king, its neighbours and the rank in front
+
+    U64 checkers;                  // Pieces giving check to the side to move
+    U64 pinned;                    // Side to move's pieces pinned to its king
+
+    int mobility[2][NB_PIECES];    // Attacked squares not occupied by our own pieces
+    int kingAttacks[2][NB_PIECES]; // Attacks into the enemy king zone
+} AttackInfo;
+
+// Attack info is kept per ply so that a node's info survives searching its
+// children. Slots are checked against the hash, so a line deeper than this
+// wrapping around only costs a recomputation
+#define ATTACK_INFO_SLOTS 128 // Must be a power of 2
+
+// NNUE accumulator, the first layer of the network for both perspectives
+// Kept per ply like the attack info and updated by makeMove(), see nnue.h
+#define NNUE_HIDDEN 256
+#define ACCUMULATOR_SLOTS 128 // Must be a power of 2
+
+typedef struct {
+    int16_t values[2][NNUE_HIDDEN]; // [perspective][neuron]
+    U64 hash;                       // Position the values are for
+    int network;                    // Network they were computed with, see loadNetwork()
+} Accumulator;
+
 // Board Representation
 typedef struct {
     U64 colors[3];   // Occupancies for colors WHITE, BLACK and BOTH
@@ -82,10 +120,18 @@ typedef struct {
     int castlePerm;  // Castle permissions for both sides in 4 bits (KQkq)
     int fiftyMove;   // 50 move rule counter
     int ply;         // Half moves since start of game
+    int fullMoves;   // Full move counter from the FEN, at ply 0
 
     U64 hash;        // Zobrist hash
+    U64 pawnHash;    // Zobrist hash of just the pawns, for the pawn hash table
+
+    int materialPSQT;    // Packed material + PSQT score from white's perspective, see S()
+    int phase;           // Phase of the pieces on the board, see getGamePhase()
 
     Undo history[MAX_MOVES]; // Undo array
+
+    AttackInfo attackInfo[ATTACK_INFO_SLOTS]; // Indexed by ply, see getAttackInfo()
+    Accumulator accumulators[ACCUMULATOR_SLOTS]; // Indexed by ply, see nnue.c
 } Board;
 
 // Square helper functions
@@ -100,9 +146,13 @@ bool fileRankInBoard(int file, int rank);
 int isSquareAttacked(Board *board, int color, int square);
 U64 allAttackersToSquare(Board *board, U64 occupied, int sq);
 U64 attackersToKingSquare(Board *board);
+AttackInfo *getAttackInfo(Board *board);
+AttackInfo *cachedAttackInfo(Board *board);
 void printBoard(Board *board);
 void clearBoard(Board *board);
 void parseFen(Board *board, char *fen);
+int fullMoveNumber(Board *board);
+void boardToFen(Board *board, char *fen);
 int isDraw(Board *board);
 int isPawnEndgame(Board *board, int side);
 
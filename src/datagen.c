@@ -0,0 +1,255 @@
+#include "datagen.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "hashtable.h"
+#include "makemove.h"
+#include "move.h"
+#include "movegen.h"
+#include "packed.h"
+#include "search.h"
+#include "threads.h"
+#include "timeman.h"
+
+// Shared between the datagen threads
+typedef struct {
+    PackedWriter writer;
+    pthread_mutex_t writeLock;
+
+    int games;
+    int nodes;
+    int startTime;
+
+    // Updated atomically
+    int gamesStarted;
+    int gamesDone;
+    long positions;
+} Datagen;
+
+typedef struct {
+    Datagen *datagen;
+    SearchThread *thread;
+    SearchInfo info;
+    HashTable hashTable;
+    U64 seed;
+
+    // Finished positions waiting to be written
+    PackedPosition buffer[DATAGEN_BUFFER_SIZE];
+    int buffered;
+
+    pthread_t handle;
+} DatagenThread;
+
+// XOR shift, see randomU64()
+static U64 nextRandom(DatagenThread *dt) {
+    dt->seed ^= dt->seed >> 12;
+    dt->seed ^= dt->seed << 25;
+    dt->seed ^= dt->seed >> 27;
+    return dt->seed * 0x2545F4914F6CDD1DULL;
+}
+
+static void flushBuffer(DatagenThread *dt) {
+    Datagen *datagen = dt->datagen;
+
+    pthread_mutex_lock(&datagen->writeLock);
+    if (!writePackedPositions(&datagen->writer, dt->buffer, dt->buffered)) {
+        puts("Failed to write datagen positions.");
+        exit(1);
+    }
+    pthread_mutex_unlock(&datagen->writeLock);
+
+    __atomic_add_fetch(&datagen->positions, dt->buffered, __ATOMIC_RELAXED);
+    dt->buffered = 0;
+}
+
+// Only kings and at most one minor piece left
+static bool insufficientMaterial(Board *board) {
+    U64 minors = board->pieces[KNIGHT] | board->pieces[BISHOP];
+    U64 majors = board->pieces[PAWN] | board->pieces[ROOK] | board->pieces[QUEEN];
+    return majors == 0ULL && popCount(minors) <= 1;
+}
+
+// Plays the random opening moves
+// Returns false if the game ended during them
+static bool playRandomOpening(DatagenThread *dt) {
+    Board *board = &dt->thread->board;
+    parseFen(board, START_FEN);
+
+    // An odd number of plies now and then, so both sides get to move first
+    int plies = DATAGEN_RANDOM_PLIES + (nextRandom(dt) & 1);
+    for (int i = 0; i < plies; i++) {
+        MoveList moves;
+        moves.count = 0;
+        generateLegalMoves(&moves, board);
+        if (moves.count == 0)
+            return false;
+
+        makeMove(board, moves.list[nextRandom(dt) % moves.count]);
+    }
+    return true;
+}
+
+// Searches the game's current position to the node limit
+static void searchGamePosition(DatagenThread *dt) {
+    dt->info.nodeLimit = dt->datagen->nodes;
+    dt->info.depthToSearch = MAX_SEARCH_DEPTH - 1;
+    dt->info.stopped = false;
+    dt->info.quit = false;
+    dt->info.timeSet = false;
+    dt->info.silent = true;
+
+    searchSingleThread(dt->thread);
+}
+
+// Plays one game and buffers its quiet positions with the result
+static void playGame(DatagenThread *dt) {
+    SearchThread *thread = dt->thread;
+    Board *board = &thread->board;
+
+    if (!playRandomOpening(dt))
+        return;
+
+    // Start from a clean table every game so games don't depend on each other
+    resetHashTable(&dt->hashTable);
+
+    PackedPosition positions[DATAGEN_MAX_PLIES];
+    int count = 0;
+    int result = 1; // Draw unless something else happens
+    int winPlies = 0, drawPlies = 0;
+
+    for (int ply = 0; ply < DATAGEN_MAX_PLIES; ply++) {
+        MoveList moves;
+        moves.count = 0;
+        generateLegalMoves(&moves, board);
+
+        // Checkmate or stalemate
+        bool inCheck = attackersToKingSquare(board) != 0ULL;
+        if (moves.count == 0) {
+            if (inCheck)
+                result = (board->side == WHITE) ? 0 : 2;
+            break;
+        }
+
+        if (isDraw(board) || insufficientMaterial(board))
+            break;
+
+        searchGamePosition(dt);
+        Move move = thread->bestMove;
+        if (move == NO_MOVE)
+            move = moves.list[0];
+
+        int score = thread->score;
+        int whiteScore = (board->side == WHITE) ? score : -score;
+
+        // Lopsided openings teach nothing
+        if (ply == 0 && abs(score) > DATAGEN_OPENING_LIMIT)
+            return;
+
+        // Adjudication
+        winPlies = (abs(score) >= DATAGEN_WIN_SCORE) ? winPlies + 1 : 0;
+        drawPlies = (abs(score) <= DATAGEN_DRAW_SCORE && ply >= DATAGEN_DRAW_START) ? drawPlies + 1 : 0;
+        if (winPlies >= DATAGEN_WIN_PLIES) {
+            result = (whiteScore > 0) ? 2 : 0;
+            break;
+        }
+        if (drawPlies >= DATAGEN_DRAW_PLIES)
+            break;
+
+        // Only keep quiet positions, where the static evaluation has a
+        // chance of matching the search
+        if (!inCheck && !IsCapture(move) && !IsPromotion(move) && abs(score) < MATE - MAX_SEARCH_DEPTH)
+            packPosition(board, 0, whiteScore, &positions[count++]);
+
+        makeMove(board, move);
+    }
+
+    for (int i = 0; i < count; i++) {
+        positions[i].result = result;
+        dt->buffer[dt->buffered++] = positions[i];
+        if (dt->buffered == DATAGEN_BUFFER_SIZE)
+            flushBuffer(dt);
+    }
+}
+
+static void *datagenWorker(void *arg) {
+    DatagenThread *dt = (DatagenThread *)arg;
+    Datagen *datagen = dt->datagen;
+
+    while (__atomic_fetch_add(&datagen->gamesStarted, 1, __ATOMIC_RELAXED) < datagen->games) {
+        playGame(dt);
+
+        int done = __atomic_add_fetch(&datagen->gamesDone, 1, __ATOMIC_RELAXED);
+        if (done % 100 == 0) {
+            int elapsed = getTime() - datagen->startTime + 1;
+            long positions = __atomic_load_n(&datagen->positions, __ATOMIC_RELAXED);
+            printf("Games %d / %d, positions %ld, %ld positions/s\n", done, datagen->games, positions,
+                   positions * 1000 / elapsed);
+        }
+    }
+
+    if (dt->buffered > 0)
+        flushBuffer(dt);
+    return NULL;
+}
+
+void runDatagen(const char *path, int games, int workers, int nodes) {
+    workers = MAX(1, MIN(workers, MAX_THREADS));
+
+    Datagen datagen = {0};
+    datagen.games = games;
+    datagen.nodes = nodes;
+    datagen.startTime = getTime();
+    pthread_mutex_init(&datagen.writeLock, NULL);
+
+    if (!openPackedWriter(&datagen.writer, path))
+        exit(1);
+
+    printf("Generating %d games with %d threads at %d nodes per move into '%s'\n", games, workers, nodes, path);
+
+    // Thread state is big, so it all lives on the heap
+    DatagenThread *dts = calloc(workers, sizeof(DatagenThread));
+    SearchThread *threadStates = calloc(workers, sizeof(SearchThread));
+    if (dts == NULL || threadStates == NULL) {
+        puts("Datagen allocation failed.");
+        exit(1);
+    }
+
+    U64 seed = (U64)getTime() * 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < workers; i++) {
+        DatagenThread *dt = &dts[i];
+        dt->datagen = &datagen;
+        dt->thread = &threadStates[i];
+        dt->seed = (seed ^ (U64)(i + 1) * 0xD1B54A32D192ED03ULL) | 1;
+
+        // Each game is searched by this thread alone
+        dt->thread->index = 0;
+        dt->thread->info = &dt->info;
+        dt->thread->hashTable = &dt->hashTable;
+        if (!allocateHashTable(&dt->hashTable, DATAGEN_HASH_MB)) {
+            puts("Datagen hash allocation failed.");
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < workers; i++)
+        pthread_create(&dts[i].handle, NULL, datagenWorker, &dts[i]);
+    for (int i = 0; i < workers; i++)
+        pthread_join(dts[i].handle, NULL);
+
+    if (!closePackedWriter(&datagen.writer))
+        printf("Failed to write '%s'\n", path);
+
+    int elapsed = getTime() - datagen.startTime + 1;
+    printf("Done: %d games, %lu positions in %.1fs\n", datagen.games, datagen.writer.count, elapsed / 1000.0);
+
+    for (int i = 0; i < workers; i++)
+        releaseHashTable(&dts[i].hashTable);
+    free(threadStates);
+    free(dts);
+    pthread_mutex_destroy(&datagen.writeLock);
+}
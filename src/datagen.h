@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+    Self-play data generation
+
+    Run with 'engine datagen [output file] [games] [threads] [nodes]'
+    The thread count defaults to every core.
+
+    Every thread plays its own games with its own board, search heuristics
+    and small hash table, searching a fixed number of nodes per move from
+    a few random opening moves. Quiet positions from each game are labelled
+    with the game result and search score and written to a packed file
+    (see packed.h), which the tuner reads directly.
+*/
+#define DATAGEN_HASH_MB 16
+#define DATAGEN_RANDOM_PLIES 8
+#define DATAGEN_MAX_PLIES 400
+#define DATAGEN_BUFFER_SIZE 4096
+
+// Openings this lopsided after the random moves aren't worth playing out
+#define DATAGEN_OPENING_LIMIT 1000
+
+// Games are adjudicated once the score has been decisive or dead level
+// for long enough
+#define DATAGEN_WIN_SCORE 2000
+#define DATAGEN_WIN_PLIES 4
+#define DATAGEN_DRAW_SCORE 10
+#define DATAGEN_DRAW_PLIES 12
+#define DATAGEN_DRAW_START 80
+
+void runDatagen(const char *path, int games, int workers, int nodes);
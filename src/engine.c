@@ -4,10 +4,13 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "bench.h"
 #include "bitboards.h"
 #include "board.h"
+#include "datagen.h"
 #include "eval.h"
 #include "hashtable.h"
 #include "magicmoves.h"
@@ -16,6 +19,7 @@
 #include "movegen.h"
 #include "movepicker.h"
 #include "search.h"
+#include "threads.h"
 #include "timeman.h"
 #include "uci.h"
 #include "zobrist.h"
@@ -32,20 +36,36 @@ void initialise() {
     initMvvLva();
     initLMRDepths();
     initDistances();
-    initPawnMasks();
+    initPSQT();
 
-    // Default hash is 256 MB
-    // TODO: Set custom hash size from UCI
-    initHashTable(256);
+    // Single threaded search by default
+    initThreads(1);
 
     // Credit to Pradu Kannan for excellent magic bitboard implementation
     initmagicmoves();
 }
 
-int main() {
+int main(int argc, char **argv) {
     welcomeMessage();
     initialise();
 
+    // engine datagen [output file] [games] [threads] [nodes], see datagen.h
+    // Every datagen thread has its own small table, so the global one is
+    // only set up for UCI. Uses every core unless told otherwise
+    if (argc > 1 && strcmp(argv[1], "datagen") == 0) {
+        int cores = MIN(MAX(1, (int)sysconf(_SC_NPROCESSORS_ONLN)), MAX_THREADS);
+        runDatagen(argc > 2 ? argv[2] : "data.bin",
+                   argc > 3 ? atoi(argv[3]) : 1000,
+                   argc > 4 ? atoi(argv[4]) : cores,
+                   argc > 5 ? atoi(argv[5]) : 5000);
+
+        freeThreads();
+        return 0;
+    }
+
+    // Default hash is 256 MB, can be changed with 'setoption name Hash'
+    initHashTable(DEFAULT_HASH_MB);
+
     // Debug flag which decides whether to run the UCI loop or debug code
     bool DEBUG = false;
 
@@ -59,11 +79,12 @@ int main() {
         // debug code here
         parseFen(&board, "8/r3k3/3ppp2/p7/3PPP2/5P2/4K3/3R4 w - - 0 1");
         printBoard(&board);
-        printf("Eval: %d\n", evaluate(&board));
+        printf("Eval: %d\n", evaluate(&board, NULL));
 
     }
 
-    // Free hash table before leaving
+    // Free hash table and threads before leaving
     freeHashTable();
+    freeThreads();
     return 0;
 }
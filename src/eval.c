@@ -1,314 +1,247 @@
 #include "eval.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "board.h"
 #include "magicmoves.h"
-
-U64 fileMasks[8];
-U64 rankMasks[8];
-U64 adjacentFileMasks[8];
-U64 passedPawnMasks[2][64];
-
-U64 fillUp(int startRank) {
-    U64 mask = 0ULL;
-    for (int rank = startRank + 1; rank < 8; rank++)
-    {
-        mask |= rankMasks[rank];
-    }
-
-    return mask;
+#include "nnue.h"
+
+Score PSQTScores[2 * NB_PIECES][64];
+
+// Names and sizes of the EvalTrace fields, in order
+const TraceGroup traceGroups[NB_TRACE_GROUPS] = {
+    {"Material", NB_PIECES},
+    {"PSQT", NB_PIECES * 64},
+    {"Mobility", NB_PIECES},
+    {"King attacks", NB_PIECES},
+    {"Passed pawns", 8},
+    {"Isolated pawns", 1},
+    {"Doubled pawns", 1},
+    {"Backward pawns", 1},
+    {"Connected pawns", 1},
+    {"Bishop pair", 1},
+    {"Side to move", 1},
+};
+
+// Trace being filled in by this thread, NULL when not tracing
+// Thread local so tracing from the UCI thread can't collide with a search
+static _Thread_local EvalTrace *activeTrace = NULL;
+
+#define TRACE_ADD(term, color, count)                 \
+    do {                                              \
+        if (activeTrace != NULL)                      \
+            activeTrace->term[color] += (count);      \
+    } while (0)
+
+// Setwise pawn helpers
+// Directions are relative to color so both sides share the same code
+static inline U64 pawnForward(U64 pawns, int color) {
+    return (color == WHITE) ? pawns << 8 : pawns >> 8;
 }
 
-U64 fillDown(int startRank) {
-    U64 mask = 0ULL;
-    for (int rank = startRank - 1; rank >= 0; rank--)
-    {
-        mask |= rankMasks[rank];
-    }
+static inline U64 frontFill(U64 pawns, int color) {
+    return (color == WHITE) ? northFill(pawns) : southFill(pawns);
+}
 
-    return mask;
+static inline U64 pawnAttackSet(U64 pawns, int color) {
+    U64 pushed = pawnForward(pawns, color);
+    return shiftEast(pushed) | shiftWest(pushed);
 }
 
+static inline U64 relativeRankMask(int rank, int color) {
+    return 0xFFULL << (8 * ((color == WHITE) ? rank : 7 - rank));
+}
 
-void initPawnMasks() {
-    // Clear Masks
-    for (int i = 0; i < 8; i++) {
-        fileMasks[i] = 0ULL;
-        rankMasks[i] = 0ULL;
-        adjacentFileMasks[i] = 0ULL;
-    }
-    for (int i = 0; i < 64; i++) {
-        passedPawnMasks[middlegame][i] = 0ULL;
-        passedPawnMasks[endgame][i] = 0ULL;
+void initPSQT() {
+    // The tables are written from white's point of view with a8 first,
+    // so white mirrors the square and black uses it as is
+    for (int piece = PAWN; piece <= KING; piece++) {
+        for (int sq = 0; sq < 64; sq++) {
+            PSQTScores[toPiece(piece, WHITE)][sq] = PieceValues[piece] + PieceSquareTables[piece][MIRROR_SQ(sq)];
+            PSQTScores[toPiece(piece, BLACK)][sq] = -PieceValues[piece] - PieceSquareTables[piece][sq];
+        }
     }
+}
 
-    // File and rank masks
-    for (int square = 0; square < 64; square++) {
-        int file = fileOf(square);
-        int rank = rankOf(square);
+// Recomputes the board's material, PSQT and phase sums from scratch
+// Only used to check the incremental updates in debug builds
+int materialPSQTIsValid(Board *board) {
+    Score score = 0;
+    int phase = 0;
 
-        // File
-        setBit(&fileMasks[file], square);
-        
-        // Rank
-        setBit(&rankMasks[rank], square);
+    for (int sq = 0; sq < 64; sq++) {
+        int piece = board->squares[sq];
+        if (piece == EMPTY)
+            continue;
 
+        int color = testBit(board->colors[WHITE], sq) ? WHITE : BLACK;
+        score += PSQTScores[toPiece(piece, color)][sq];
+        phase += PhaseValues[piece];
     }
 
-    // Passed pawn masks
-    for (int square = 0; square < 64; square++) {
-        int file = fileOf(square);
-        int rank = rankOf(square);
-
-        // Mask of the adjacent files
-        U64 adjacentMask = fileMasks[file];
-        if (file > 1)
-            adjacentMask |= fileMasks[file - 1];
-        if (file < 7)
-            adjacentMask |= fileMasks[file + 1];
-        adjacentFileMasks[file] = adjacentMask;
-        
-        // White
-        U64 whiteMask = fillUp(rank) & adjacentMask;
-        passedPawnMasks[WHITE][square] = whiteMask;
-
-        // Black
-        U64 blackMask = fillDown(rank) & adjacentMask;
-        passedPawnMasks[BLACK][square] = blackMask;
-    }
+    return score == board->materialPSQT && phase == board->phase;
 }
 
-
 int getGamePhase(Board *board) {
     // Gets game phase, a value from 0 to 256 representing how
     // close to the endgame we are
-    int phase = popCount(board->pieces[KNIGHT]) * KNIGHT_PHASE +
-                popCount(board->pieces[BISHOP]) * BISHOP_PHASE +
-                popCount(board->pieces[ROOK])   * ROOK_PHASE   +
-                popCount(board->pieces[QUEEN])  * QUEEN_PHASE;
-
-    return MIN(phase, START_PHASE);
+    return MIN(board->phase, START_PHASE);
 }
 
-int getTaperedScore(int MGScore, int EGScore, int phase) {
-    // Taper a middlegame score and endgame score for the same term
-    return ((MGScore * phase) + (EGScore * (START_PHASE - phase))) >> 8; // divide by 256
+int getTaperedScore(Score score, int phase) {
+    // Taper between the middlegame and endgame halves of a score
+    // Credit: MadChess (Erik Madsen) for phase values
+    return ((ScoreMG(score) * phase) + (ScoreEG(score) * (START_PHASE - phase))) >> 8; // divide by 256
 }
 
-int evaluateMaterialPSQT(Board *board, int phase) {
-    // Tapered PSQT evaluation and material evaluation
-    int EGScore = 0;
-    int MGScore = 0;
-    U64 pieces;
-    int square;
-    int score;
-
-    // // Get black and white king attacks for calculation later
-    // U64 kings = board->pieces[KING];
-    // U64 blackKingBB = kings & board->colors[BLACK];
-    // U64 blackKingAttacks = kingAttacks(getlsb(blackKingBB));
-    // blackKingAttacks |= blackKingBB | blackKingAttacks >> 8;
+Score evaluateMobility(Board *board) {
+    // Mobility and attacks on the enemy king, straight from the attack maps
+    AttackInfo *info = getAttackInfo(board);
+    Score score = 0;
 
-    // U64 whiteKingBB = kings & board->colors[WHITE];
-    // U64 whiteKingAttacks = kingAttacks(getlsb(whiteKingBB));
-    // whiteKingAttacks |= whiteKingBB | whiteKingAttacks << 8;
+    for (int piece = KNIGHT; piece <= QUEEN; piece++) {
+        score += mobilityBonus[piece] * (info->mobility[WHITE][piece] - info->mobility[BLACK][piece]);
+        score += kingAttackBonus[piece] * (info->kingAttacks[WHITE][piece] - info->kingAttacks[BLACK][piece]);
 
-
-    // Go through all the pieces
-    for (int piece = PAWN; piece <= KING; piece++) {
-        pieces = board->pieces[piece];
-
-        // Loop through the bitboard
-        while (pieces) {
-            square = poplsb(&pieces);
-            if (testBit(board->colors[WHITE], square)) {
-                // White piece
-                MGScore += middleGamePSQT[piece][MIRROR_SQ(square)];
-                MGScore += middleGameMaterial[piece];
-
-                EGScore += endGamePSQT[piece][MIRROR_SQ(square)];
-                EGScore += endGameMaterial[piece];
-
-                // // Mobility
-                // U64 mobility;
-                // int kingAttackCount;
-                // switch (piece) {
-                //     case KNIGHT:
-                //         mobility = knightAttacks(square) & ~board->colors[WHITE];
-                //     case BISHOP:
-                //         mobility = Bmagic(square, board->colors[BOTH]) & ~board->colors[WHITE];
-                //         break;
-                //     case ROOK:
-                //         mobility = Rmagic(square, board->colors[BOTH]) & ~board->colors[WHITE];
-                //         break;
-                //     case QUEEN:
-                //         mobility = Qmagic(square, board->colors[BOTH]) & ~board->colors[WHITE];
-                //         break;
-                //     case KING:
-                //         mobility = Qmagic(square, board->colors[BOTH]) & ~board->colors[WHITE];
-                //         break;
-                //     default:
-                //         mobility = 0;
-                //         break;
-                // }
-                // // Mobility
-                // MGScore += mobilityBonus[middlegame][piece] * popCount(mobility);
-                // EGScore += mobilityBonus[endgame][piece] * popCount(mobility);
-
-                // // King attacks
-                // kingAttackCount = popCount(mobility & blackKingAttacks);
-                // MGScore += kingAttackBonus[middlegame][piece] * kingAttackCount;
-                // EGScore += kingAttackBonus[endgame][piece] * kingAttackCount;
-            } else {
-                // Black piece
-                MGScore -= middleGamePSQT[piece][square];
-                MGScore -= middleGameMaterial[piece];
-
-                EGScore -= endGamePSQT[piece][square];
-                EGScore -= endGameMaterial[piece];
-
-                // // Mobility
-                // U64 mobility;
-                // int kingAttackCount;
-                // switch (piece) {
-                //     case KNIGHT:
-                //         mobility = knightAttacks(square) & ~board->colors[BLACK];
-                //         break;
-                //     case BISHOP:
-                //         mobility = Bmagic(square, board->colors[BOTH]) & ~board->colors[BLACK];
-                //         break;
-                //     case ROOK:
-                //         mobility = Rmagic(square, board->colors[BOTH]) & ~board->colors[BLACK];
-                //         break;
-                //     case QUEEN:
-                //         mobility = Qmagic(square, board->colors[BOTH]) & ~board->colors[BLACK];
-                //         break;
-                //     case KING:
-                //         mobility = Qmagic(square, board->colors[BOTH]) & ~board->colors[BLACK];
-                //         break;
-                //     default:
-                //         mobility = 0;
-                //         break;
-                // }
-                // // Mobility
-                // MGScore -= mobilityBonus[middlegame][piece] * popCount(mobility);
-                // EGScore -= mobilityBonus[endgame][piece] * popCount(mobility);
-
-                // // King attacks
-                // kingAttackCount = popCount(mobility & whiteKingAttacks);
-                // MGScore -= kingAttackBonus[middlegame][piece] * kingAttackCount;
-                // EGScore -= kingAttackBonus[endgame][piece] * kingAttackCount;
-            }
-        }
+        TRACE_ADD(mobility[piece], WHITE, info->mobility[WHITE][piece]);
+        TRACE_ADD(mobility[piece], BLACK, info->mobility[BLACK][piece]);
+        TRACE_ADD(kingAttacks[piece], WHITE, info->kingAttacks[WHITE][piece]);
+        TRACE_ADD(kingAttacks[piece], BLACK, info->kingAttacks[BLACK][piece]);
     }
-    // Tapered eval
-    // Credit: MadChess (Erik Madsen) for phase values
 
-    score = getTaperedScore(MGScore, EGScore, phase);
-    // printf("MGScore: %d\n", MGScore);
-    // printf("EGScore: %d\n", EGScore);
-    // printf("Phase: %d\n", phase);
-    // printf("score: %d\n", score);
+    // The king's mobility is how open it would be as a queen, which is
+    // a penalty rather than a bonus in the middlegame
+    U64 occupied = board->colors[BOTH];
+    for (int color = WHITE; color <= BLACK; color++) {
+        int kingSq = getlsb(board->pieces[KING] & board->colors[color]);
+        U64 lines = Bmagic(kingSq, occupied) | Rmagic(kingSq, occupied);
+        int mobility = popCount(lines & ~board->colors[color]);
 
+        score += (color == WHITE ? 1 : -1) * mobilityBonus[KING] * mobility;
+        TRACE_ADD(mobility[KING], color, mobility);
+    }
 
-    // In negamax, we return evaluations relative to the side to move.
-    // Since this function is from white's perspective, we must negate score
-    // if we're playing from black's POV.
-    if (board->side == WHITE)
-        return score;
-    return -score;
+    return score;
 }
 
-int evaluateImbalances(Board *board) {
-    int score;
-    int us = board->side;
-    int them = !board->side;
+Score evaluateImbalances(Board *board) {
+    Score score = 0;
 
     // Bishop pair bonus
     U64 bishops = board->pieces[BISHOP];
-    if (popCount(bishops & board->colors[us]) > 1)
+    if (popCount(bishops & board->colors[WHITE]) > 1) {
         score += BISHOP_PAIR_BONUS;
-    if (popCount(bishops & board->colors[them]) > 1)
+        TRACE_ADD(bishopPair, WHITE, 1);
+    }
+    if (popCount(bishops & board->colors[BLACK]) > 1) {
         score -= BISHOP_PAIR_BONUS;
-
-
+        TRACE_ADD(bishopPair, BLACK, 1);
+    }
 
     return score;
 }
 
-int evaluateKings(Board *board, int phase, int side) {
+Score evaluateKings(Board *board, int side) {
     // King safety evaluation
     // Inspired by CPW
-    int MGScore = 0;
+    Score score = 0;
 
-    // King castling bonus
+    // King castling bonus, which only counts in the middlegame
     if (side == WHITE && (board->castlePerm & CASTLE_WK || board->castlePerm & CASTLE_WQ))
-        MGScore += CASTLE_BONUS;
+        score += CASTLE_BONUS;
     else if (side == BLACK && (board->castlePerm & CASTLE_BK || board->castlePerm & CASTLE_BQ))
-        MGScore += CASTLE_BONUS;
+        score += CASTLE_BONUS;
 
-    // Taper the eval since King safety is not applicable in endgame
-    int score = getTaperedScore(MGScore, 0, phase);
+    return score;
+}
+
+Score evaluatePawns(Board *board, int side) {
+    // Evaluates pawn structure for one side
+    // Each feature is a bitboard of the pawns which have it, so there's no
+    // looping over pawns and the result only depends on the pawns
+    U64 ours = board->pieces[PAWN] & board->colors[side];
+    U64 theirs = board->pieces[PAWN] & board->colors[!side];
+    U64 ourAttacks = pawnAttackSet(ours, side);
+    U64 theirAttacks = pawnAttackSet(theirs, !side);
+
+    // Passed: no enemy pawn ahead of it on its own or an adjacent file
+    U64 theirFrontSpans = frontFill(pawnForward(theirs, !side), !side);
+    U64 passed = ours & ~(theirFrontSpans | shiftEast(theirFrontSpans) | shiftWest(theirFrontSpans));
+
+    // Isolated: no friendly pawn on an adjacent file
+    U64 ourFiles = fileFill(ours);
+    U64 isolated = ours & ~(shiftEast(ourFiles) | shiftWest(ourFiles));
+
+    // Doubled: another friendly pawn ahead of it on the same file
+    U64 doubled = ours & frontFill(pawnForward(ours, !side), !side);
+
+    // Backward: its stop square is controlled by an enemy pawn and no
+    // friendly pawn can ever advance to defend it
+    U64 ourAttackSpans = frontFill(ourAttacks, side);
+    U64 backward = ours & pawnForward(pawnForward(ours, side) & theirAttacks & ~ourAttackSpans, !side);
+
+    // Connected: defended by a pawn or standing next to one
+    U64 connected = ours & (ourAttacks | shiftEast(ours) | shiftWest(ours));
+
+    Score score = 0;
+    for (int rank = 1; rank < 7; rank++) {
+        score += passedPawnBonus[rank] * popCount(passed & relativeRankMask(rank, side));
+        TRACE_ADD(passedPawn[rank], side, popCount(passed & relativeRankMask(rank, side)));
+    }
 
+    score -= ISOLATED_PAWN_PENALTY * popCount(isolated);
+    score -= DOUBLED_PAWN_PENALTY * popCount(doubled);
+    score -= BACKWARD_PAWN_PENALTY * popCount(backward);
+    score += CONNECTED_PAWN_BONUS * popCount(connected);
+
+    // Penalties are subtracted, so they're traced negatively
+    TRACE_ADD(isolatedPawn, side, -popCount(isolated));
+    TRACE_ADD(doubledPawn, side, -popCount(doubled));
+    TRACE_ADD(backwardPawn, side, -popCount(backward));
+    TRACE_ADD(connectedPawn, side, popCount(connected));
 
     return score;
 }
 
-int evaluatePawns(Board *board, int phase, int side) {
-    // Evaluates pawn structure
-    int score;
-    int MGScore;
-    int EGScore;
-    int square;
-    int rank, file;
-
-    // Loop through all our pawns
-    U64 ourPawns = board->pieces[PAWN] & board->colors[side];
-    U64 ourPawnsSaved = ourPawns;
-    U64 enemyPawns = board->pieces[PAWN] & board->colors[!side];
-    while (ourPawns) {
-        square = poplsb(&ourPawns);
-        file = fileOf(square);
-        rank = rankOf(square);
-        if (side == BLACK) rank = 7 - rank;
-
-        // Passed pawn
-        if ((passedPawnMasks[side][square] & enemyPawns) == 0) {
-            MGScore += passedPawnBonus[middlegame][rank];
-            EGScore += passedPawnBonus[endgame][rank];
-        }
-
-        // Isolated pawn
-        if (adjacentFileMasks[file] & ourPawnsSaved & ~fileMasks[file] == 0ULL) {
-            MGScore -= ISOLATED_PAWN_PENALTY;
-            EGScore -= ISOLATED_PAWN_PENALTY;
-        }
+// Pawn structure evaluation from white's perspective
+// Probes the pawn hash table first if we were given one
+Score evaluatePawnStructure(Board *board, PawnHashTable *pawnTable) {
+    PawnHashEntry *entry = NULL;
 
-        // Doubled pawn
-        if (popCount(fileMasks[file] & ourPawnsSaved) > 1) {
-            MGScore -= DOUBLED_PAWN_PENALTY_MG;
-            EGScore -= DOUBLED_PAWN_PENALTY_EG;
-        }
+    if (pawnTable != NULL) {
+        entry = &pawnTable->entries[board->pawnHash & (PAWN_HASH_SIZE - 1)];
+        if (entry->pawnHash == board->pawnHash)
+            return entry->score;
     }
 
-    score = getTaperedScore(MGScore, EGScore, phase);
+    Score score = evaluatePawns(board, WHITE) - evaluatePawns(board, BLACK);
 
+    if (entry != NULL) {
+        entry->pawnHash = board->pawnHash;
+        entry->score = score;
+    }
     return score;
 }
 
-// Calculates the evaluation of the board from the side to move's perspective
-int evaluate(Board *board) {
-    int score;
-    int phase = getGamePhase(board);
-    score += evaluateMaterialPSQT(board, phase);
+// Hand written evaluation from the side to move's perspective
+static int evaluateClassical(Board *board, PawnHashTable *pawnTable) {
+    // Every term is added up from white's perspective and tapered once
+    // The board keeps the material and PSQT sum up to date as pieces move
+    Score score = board->materialPSQT;
+    score += evaluateMobility(board);
     score += evaluateImbalances(board);
+    score += evaluatePawnStructure(board, pawnTable);
 
-    // score += evaluateKings(board, phase, board->side) - evaluateKings(board, phase, !board->side);
-    score += evaluatePawns(board, phase, board->side) - evaluatePawns(board, phase, !board->side);
+    // score += evaluateKings(board, WHITE) - evaluateKings(board, BLACK);
 
+    int eval = getTaperedScore(score, getGamePhase(board));
 
+    // In negamax, we return evaluations relative to the side to move.
+    if (board->side == BLACK)
+        eval = -eval;
 
     /*
     If it's our turn to move, it's likely we are able to find a move which
@@ -317,7 +250,154 @@ int evaluate(Board *board) {
     (which is us). Of course, this proposition is not valid if we're in zugzwang,
     however that is rare and can be counteracted if we just search deeper
     */
-   score += STM_BONUS;
+    eval += STM_BONUS;
 
-    return score;
+    return eval;
+}
+
+// Calculates the evaluation of the board from the side to move's perspective
+// pawnTable may be NULL, in which case pawn structure is always recomputed
+int evaluate(Board *board, PawnHashTable *pawnTable) {
+    if (useNNUE)
+        return nnueEvaluate(board);
+
+    return evaluateClassical(board, pawnTable);
+}
+
+// evaluate() with a lookup in the evaluation cache first
+int cachedEvaluate(Board *board, EvalCache *evalCache, PawnHashTable *pawnTable) {
+    EvalCacheEntry *entry = &evalCache->entries[board->hash & (EVAL_CACHE_SIZE - 1)];
+    if (entry->hash == board->hash)
+        return entry->eval;
+
+    entry->hash = board->hash;
+    entry->eval = evaluate(board, pawnTable);
+    return entry->eval;
+}
+
+// Evaluates the board with the hand written evaluation and records every
+// weight it used in trace, along with the phase
+// Returns the evaluation from white's perspective
+int traceEvaluation(Board *board, EvalTrace *trace) {
+    memset(trace, 0, sizeof(EvalTrace));
+    activeTrace = trace;
+
+    // The running material and PSQT sum can't be traced, so count the
+    // pieces instead
+    for (int sq = 0; sq < 64; sq++) {
+        int piece = board->squares[sq];
+        if (piece == EMPTY)
+            continue;
+
+        int color = testBit(board->colors[WHITE], sq) ? WHITE : BLACK;
+        TRACE_ADD(pieceValues[piece], color, 1);
+        TRACE_ADD(psqt[piece][color == WHITE ? MIRROR_SQ(sq) : sq], color, 1);
+    }
+    TRACE_ADD(stm, board->side, 1);
+
+    // No pawn table, a cached score would skip the pawn terms
+    int eval = evaluateClassical(board, NULL);
+    activeTrace = NULL;
+
+    trace->phase = getGamePhase(board);
+    trace->eval = (board->side == WHITE) ? eval : -eval;
+    return trace->eval;
+}
+
+// Traces a batch of positions given as FENs into traces
+// Returns how many were traced, which is count unless we ran out of memory
+int traceEvaluations(char **fens, int count, EvalTrace *traces) {
+    // Boards are too big for the stack
+    Board *board = malloc(sizeof(Board));
+    if (board == NULL)
+        return 0;
+
+    for (int i = 0; i < count; i++) {
+        parseFen(board, fens[i]);
+        traceEvaluation(board, &traces[i]);
+    }
+
+    free(board);
+    return count;
+}
+
+// White's count minus black's for a term, i.e. the coefficient of its
+// weight in the evaluation from white's perspective
+int traceCoefficient(const EvalTrace *trace, int term) {
+    const int (*counts)[2] = (const int (*)[2])trace;
+    return counts[term][WHITE] - counts[term][BLACK];
+}
+
+// The weight each trace term stands for, in trace order
+void traceWeights(Score weights[NB_TRACE_TERMS]) {
+    int i = 0;
+
+    for (int piece = PAWN; piece <= KING; piece++)
+        weights[i++] = PieceValues[piece];
+    for (int piece = PAWN; piece <= KING; piece++)
+        for (int sq = 0; sq < 64; sq++)
+            weights[i++] = PieceSquareTables[piece][sq];
+    for (int piece = PAWN; piece <= KING; piece++)
+        weights[i++] = mobilityBonus[piece];
+    for (int piece = PAWN; piece <= KING; piece++)
+        weights[i++] = kingAttackBonus[piece];
+    for (int rank = 0; rank < 8; rank++)
+        weights[i++] = passedPawnBonus[rank];
+    weights[i++] = ISOLATED_PAWN_PENALTY;
+    weights[i++] = DOUBLED_PAWN_PENALTY;
+    weights[i++] = BACKWARD_PAWN_PENALTY;
+    weights[i++] = CONNECTED_PAWN_BONUS;
+    weights[i++] = BISHOP_PAIR_BONUS;
+    weights[i++] = S(STM_BONUS, STM_BONUS);
+}
+
+// Prints a breakdown of the evaluation for the 'eval' command
+void printEvaluation(Board *board) {
+    EvalTrace trace;
+    Score weights[NB_TRACE_TERMS];
+    traceEvaluation(board, &trace);
+    traceWeights(weights);
+
+    const int (*counts)[2] = (const int (*)[2])&trace;
+
+    puts("            Term |    White    |    Black    |    Total");
+    puts("                 |   MG    EG  |   MG    EG  |   MG    EG");
+    puts(" ----------------+-------------+-------------+------------");
+
+    int term = 0;
+    for (int group = 0; group < NB_TRACE_GROUPS; group++) {
+        int mg[2] = {0, 0}, eg[2] = {0, 0};
+        for (int i = 0; i < traceGroups[group].count; i++, term++) {
+            for (int color = WHITE; color <= BLACK; color++) {
+                mg[color] += counts[term][color] * ScoreMG(weights[term]);
+                eg[color] += counts[term][color] * ScoreEG(weights[term]);
+            }
+        }
+        printf(" %15s | %5d %5d | %5d %5d | %5d %5d\n", traceGroups[group].name,
+               mg[WHITE], eg[WHITE], mg[BLACK], eg[BLACK], mg[WHITE] - mg[BLACK], eg[WHITE] - eg[BLACK]);
+    }
+
+    printf("\nPhase: %d / %d\n", trace.phase, START_PHASE);
+    printf("Classical evaluation: %d (white side)\n", trace.eval);
+    if (networkLoaded()) {
+        int eval = nnueEvaluate(board);
+        printf("NNUE evaluation: %d (white side)\n", (board->side == WHITE) ? eval : -eval);
+    }
+
+    // Nonzero white - black coefficients, as the tuner sees the position
+    printf("\nCoefficients:");
+    term = 0;
+    for (int group = 0; group < NB_TRACE_GROUPS; group++) {
+        for (int i = 0; i < traceGroups[group].count; i++, term++) {
+            int coef = traceCoefficient(&trace, term);
+            if (coef == 0)
+                continue;
+
+            if (traceGroups[group].count > 1)
+                printf(" %s[%d]=%d", traceGroups[group].name, i, coef);
+            else
+                printf(" %s=%d", traceGroups[group].name, coef);
+        }
+    }
+    printf("\n");
 }
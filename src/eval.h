@@ -1,155 +1,106 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "board.h"
 
 // Min and max
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
 #define MAX(A, B) ((A) > (B) ? (A) : (B))
 
-static const int middleGameMaterial[NB_PIECES] = {
-    85, 320, 325, 480, 1000, 100000,
-};
+// Packed scores
+// The middlegame and endgame halves of a score share one int, the endgame
+// in the high 16 bits, so terms are added together and tapered once
+typedef int Score;
 
-static const int endGameMaterial[NB_PIECES] = {
-    95, 320, 325, 510, 970, 100000
-};
+#define S(mg, eg) ((int)((unsigned int)(eg) << 16) + (mg))
+#define ScoreMG(s) ((int16_t)(uint16_t)(unsigned int)(s))
+#define ScoreEG(s) ((int16_t)(uint16_t)((unsigned int)((s) + 0x8000) >> 16))
 
-static const int middleGamePSQT[NB_PIECES][64] = {
-    // Pawns
-      0,  0,  0,  0,  0,  0,  0,  0,
-     50, 50, 50, 50, 50, 50, 50, 50,
-     10, 20, 20, 30, 30, 20, 20, 10,
-      5,  5,  5, 23, 25,  5,  5,  5,
-      2, -5,  5, 17, 20,  0,  0,  2,
-      3,  0,  2,  2,  3, -5,  3,  4,
-      5, 10,  0,-11,-11, 13, 10,  3,
-      0,  0,  0,  0,  0,  0,  0,  0,
-    // Knights
-    -30,-20,-20,-20,-20,-20,-20,-30,
-    -20,-10,  0,  0,  0,  0,-10,-20,
-    -20,  0, 15, 25, 25, 15,  0,-20,
-    -20,  5, 20, 20, 20, 20,  5,-20,
-    -20,  0,  7, 15, 15,  8,  0,-20,
-    -20,  5,  4,  4,  4,  5,  5,-20,
-    -20,-10,  0,  1,  1,  0,-10,-20,
-    -30, -5, -3, -3, -3, -3, -5,-30,
-    // Bishops
-    -10,-10,-10,-10,-10,-10,-10,-10,
-     -2,  5,  0,  0,  0,  0,  5, -2,
-     -2,  3,  5, 10, 10,  5,  3, -2,
-     -2,  9,  6, 15, 15,  6,  9, -2,
-     -2,  0,  9, 15, 15,  9,  0, -2,
-     -2,  2,  5,  3,  3,  5,  2, -3,
-     -2,  5,  1,  1,  1,  1, 15, -2,
-    -10, -5, -5, -4, -4, -5, -5,-10,
-    // Rooks
-      5,  5,  5,  5,  5,  5,  5,  5,
-     10, 20, 20, 20, 20, 20, 20, 10,
-     -5,  0,  0,  3,  3,  0,  0, -5,
-     -5,  0,  0,  3,  3,  0,  0, -5,
-     -5,  0,  0,  3,  3,  0,  0, -5,
-     -5,  0,  5,  3,  3,  3,  0, -5,
-     -8,  0,  0,  3,  3,  0,  0, -8,
-    -10, -8,  5, 10, 10,  5, -8,-10,
-    // Queens
-    -30,-25,-25,-25,-25,-25,-10,-30,
-    -10,-10,-20,-20,-20,-20,-10,-10,
-    -10,-10,-15,-15,-15,-15,-10,-10,
-    -10,-10,-15,-15,-15,-15,-10,-10,
-     -5,-10,-10,-10,-10,-10,-10, -5,
-     -5, -5,  0,  0,  0,  0, -5, -5,
-     -5, -5,  9,  5,  5,  2, -5, -5,
-    -10, -5, -2, -2, -2, -2, -5,-10,
-    // Kings
-    -30,-40,-40,-50,-50,-40,-40,-30,
-    -30,-40,-40,-50,-50,-40,-40,-30,
-    -30,-40,-40,-50,-50,-40,-40,-30,
-    -30,-30,-30,-30,-30,-30,-30,-30,
-    -20,-20,-20,-20,-20,-20,-20,-20,
-    -10,-20,-15,-20,-20,-15,-20,-10,
-     20, 11,-10,-10,-10,-10, 12, 20,
-     15, 25,  3, -5, -5,  5, 28, 18,
+// Kings are always on the board so their material would cancel out anyway
+static const Score PieceValues[NB_PIECES] = {
+    S(85, 95), S(320, 320), S(325, 325), S(480, 510), S(1000, 970), S(0, 0),
 };
 
-static const int endGamePSQT[NB_PIECES][64] = {
+// Written from white's point of view with a8 first
+static const Score PieceSquareTables[NB_PIECES][64] = {
     // Pawns
-      0,  0,  0,  0,  0,  0,  0,  0,
-    150,130,120,120,120,120,130,150,
-     90, 80, 80, 80, 80, 80, 80, 90,
-     40, 35, 32, 30, 30, 32, 35, 40,
-     20, 15, 12,  5,  5, 12, 15, 20,
-     10,  5,  2,  0,  0,  2,  5, 10,
-     10,  5,  2,  0,  0,  2,  5, 10,
-      0,  0,  0,  0,  0,  0,  0,  0,
+    S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0),
+    S( 50, 150), S( 50, 130), S( 50, 120), S( 50, 120), S( 50, 120), S( 50, 120), S( 50, 130), S( 50, 150),
+    S( 10,  90), S( 20,  80), S( 20,  80), S( 30,  80), S( 30,  80), S( 20,  80), S( 20,  80), S( 10,  90),
+    S(  5,  40), S(  5,  35), S(  5,  32), S( 23,  30), S( 25,  30), S(  5,  32), S(  5,  35), S(  5,  40),
+    S(  2,  20), S( -5,  15), S(  5,  12), S( 17,   5), S( 20,   5), S(  0,  12), S(  0,  15), S(  2,  20),
+    S(  3,  10), S(  0,   5), S(  2,   2), S(  2,   0), S(  3,   0), S( -5,   2), S(  3,   5), S(  4,  10),
+    S(  5,  10), S( 10,   5), S(  0,   2), S(-11,   0), S(-11,   0), S( 13,   2), S( 10,   5), S(  3,  10),
+    S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0),
     // Knights
-    -30,-20,-20,-20,-20,-20,-20,-30,
-    -20,-15, -5, -5, -5, -5,-15,-20,
-    -20, -5,  5,  5,  5,  5, -5,-20,
-    -20, -5,  5, 10, 10,  5, -5,-20,
-    -20, -5,  5, 10, 10,  5, -5,-20,
-    -20, -5,  5,  5,  5,  5, -5,-20,
-    -20,-15, -5, -5, -5, -5,-15,-20,
-    -30,-20,-20,-20,-20,-20,-20,-30,
+    S(-30, -30), S(-20, -20), S(-20, -20), S(-20, -20), S(-20, -20), S(-20, -20), S(-20, -20), S(-30, -30),
+    S(-20, -20), S(-10, -15), S(  0,  -5), S(  0,  -5), S(  0,  -5), S(  0,  -5), S(-10, -15), S(-20, -20),
+    S(-20, -20), S(  0,  -5), S( 15,   5), S( 25,   5), S( 25,   5), S( 15,   5), S(  0,  -5), S(-20, -20),
+    S(-20, -20), S(  5,  -5), S( 20,   5), S( 20,  10), S( 20,  10), S( 20,   5), S(  5,  -5), S(-20, -20),
+    S(-20, -20), S(  0,  -5), S(  7,   5), S( 15,  10), S( 15,  10), S(  8,   5), S(  0,  -5), S(-20, -20),
+    S(-20, -20), S(  5,  -5), S(  4,   5), S(  4,   5), S(  4,   5), S(  5,   5), S(  5,  -5), S(-20, -20),
+    S(-20, -20), S(-10, -15), S(  0,  -5), S(  1,  -5), S(  1,  -5), S(  0,  -5), S(-10, -15), S(-20, -20),
+    S(-30, -30), S( -5, -20), S( -3, -20), S( -3, -20), S( -3, -20), S( -3, -20), S( -5, -20), S(-30, -30),
     // Bishops
-     -3,-10,-10,-10,-10,-10,-10, -3,
-    -10,  5, -5, -5, -5, -5,  5,-10,
-    -10,  0, 10,  5,  5, 10,  0,-10,
-    -10,  0,  8, 15, 15,  8,  0,-10,
-    -10,  0,  8, 15, 15,  8,  0,-10,
-    -10,  0, 10,  5,  5, 10,  0,-10,
-    -10,  5,  0,  0,  0,  0,  5,-10,
-     -3,-10,-10,-10,-10,-10,-10, -3,
+    S(-10,  -3), S(-10, -10), S(-10, -10), S(-10, -10), S(-10, -10), S(-10, -10), S(-10, -10), S(-10,  -3),
+    S( -2, -10), S(  5,   5), S(  0,  -5), S(  0,  -5), S(  0,  -5), S(  0,  -5), S(  5,   5), S( -2, -10),
+    S( -2, -10), S(  3,   0), S(  5,  10), S( 10,   5), S( 10,   5), S(  5,  10), S(  3,   0), S( -2, -10),
+    S( -2, -10), S(  9,   0), S(  6,   8), S( 15,  15), S( 15,  15), S(  6,   8), S(  9,   0), S( -2, -10),
+    S( -2, -10), S(  0,   0), S(  9,   8), S( 15,  15), S( 15,  15), S(  9,   8), S(  0,   0), S( -2, -10),
+    S( -2, -10), S(  2,   0), S(  5,  10), S(  3,   5), S(  3,   5), S(  5,  10), S(  2,   0), S( -3, -10),
+    S( -2, -10), S(  5,   5), S(  1,   0), S(  1,   0), S(  1,   0), S(  1,   0), S( 15,   5), S( -2, -10),
+    S(-10,  -3), S( -5, -10), S( -5, -10), S( -4, -10), S( -4, -10), S( -5, -10), S( -5, -10), S(-10,  -3),
     // Rooks
-      0,  5,  5,  5,  5,  5,  5,  0,
-     15, 20, 20, 20, 20, 20, 20, 15,
-     -5,  0,  5,  5,  5,  5,  0, -5,
-     -5,  0,  5,  5,  5,  5,  0, -5,
-     -5,  0,  5,  5,  5,  5,  0, -5,
-     -5,  0,  3,  3,  3,  3,  0, -5,
-     -5,  0,  0,  0,  0,  0,  0, -5,
-     -5,-10,-10,-10,-10,-10,-10, -5,
+    S(  5,   0), S(  5,   5), S(  5,   5), S(  5,   5), S(  5,   5), S(  5,   5), S(  5,   5), S(  5,   0),
+    S( 10,  15), S( 20,  20), S( 20,  20), S( 20,  20), S( 20,  20), S( 20,  20), S( 20,  20), S( 10,  15),
+    S( -5,  -5), S(  0,   0), S(  0,   5), S(  3,   5), S(  3,   5), S(  0,   5), S(  0,   0), S( -5,  -5),
+    S( -5,  -5), S(  0,   0), S(  0,   5), S(  3,   5), S(  3,   5), S(  0,   5), S(  0,   0), S( -5,  -5),
+    S( -5,  -5), S(  0,   0), S(  0,   5), S(  3,   5), S(  3,   5), S(  0,   5), S(  0,   0), S( -5,  -5),
+    S( -5,  -5), S(  0,   0), S(  5,   3), S(  3,   3), S(  3,   3), S(  3,   3), S(  0,   0), S( -5,  -5),
+    S( -8,  -5), S(  0,   0), S(  0,   0), S(  3,   0), S(  3,   0), S(  0,   0), S(  0,   0), S( -8,  -5),
+    S(-10,  -5), S( -8, -10), S(  5, -10), S( 10, -10), S( 10, -10), S(  5, -10), S( -8, -10), S(-10,  -5),
     // Queens
-    -10,-10,-10,-10,-10,-10,-10,-10,
-    -10, -5, -5, -5, -5, -5, -5,-10,
-    -10, -5,  5,  5,  5,  5, -5,-10,
-    -10, -5,  5, 10, 10,  5, -5,-10,
-    -10, -5,  5, 10, 10,  5, -5,-10,
-    -10, -5,  5,  5,  5,  5, -5,-10,
-    -10, -5, -5, -5, -5, -5, -5,-10,
-    -10,-10,-10,-10,-10,-10,-10,-10,
+    S(-30, -10), S(-25, -10), S(-25, -10), S(-25, -10), S(-25, -10), S(-25, -10), S(-10, -10), S(-30, -10),
+    S(-10, -10), S(-10,  -5), S(-20,  -5), S(-20,  -5), S(-20,  -5), S(-20,  -5), S(-10,  -5), S(-10, -10),
+    S(-10, -10), S(-10,  -5), S(-15,   5), S(-15,   5), S(-15,   5), S(-15,   5), S(-10,  -5), S(-10, -10),
+    S(-10, -10), S(-10,  -5), S(-15,   5), S(-15,  10), S(-15,  10), S(-15,   5), S(-10,  -5), S(-10, -10),
+    S( -5, -10), S(-10,  -5), S(-10,   5), S(-10,  10), S(-10,  10), S(-10,   5), S(-10,  -5), S( -5, -10),
+    S( -5, -10), S( -5,  -5), S(  0,   5), S(  0,   5), S(  0,   5), S(  0,   5), S( -5,  -5), S( -5, -10),
+    S( -5, -10), S( -5,  -5), S(  9,  -5), S(  5,  -5), S(  5,  -5), S(  2,  -5), S( -5,  -5), S( -5, -10),
+    S(-10, -10), S( -5, -10), S( -2, -10), S( -2, -10), S( -2, -10), S( -2, -10), S( -5, -10), S(-10, -10),
     // Kings
-    -70,-50,-50,-50,-50,-50,-50,-70,
-    -50,-20,-20,-20,-20,-20,-20,-50,
-    -50,-20,  0,  0,  0,  0,-20,-50,
-    -50,-20,  0,  5,  5,  0,-20,-50,
-    -50,-20,  0,  5,  5,  0,-20,-50,
-    -50,-20,  0,  0,  0,  0,-20,-50,
-    -50,-20,-20,-20,-20,-20,-20,-50,
-    -70,-50,-50,-50,-50,-50,-50,-70,
+    S(-30, -70), S(-40, -50), S(-40, -50), S(-50, -50), S(-50, -50), S(-40, -50), S(-40, -50), S(-30, -70),
+    S(-30, -50), S(-40, -20), S(-40, -20), S(-50, -20), S(-50, -20), S(-40, -20), S(-40, -20), S(-30, -50),
+    S(-30, -50), S(-40, -20), S(-40,   0), S(-50,   0), S(-50,   0), S(-40,   0), S(-40, -20), S(-30, -50),
+    S(-30, -50), S(-30, -20), S(-30,   0), S(-30,   5), S(-30,   5), S(-30,   0), S(-30, -20), S(-30, -50),
+    S(-20, -50), S(-20, -20), S(-20,   0), S(-20,   5), S(-20,   5), S(-20,   0), S(-20, -20), S(-20, -50),
+    S(-10, -50), S(-20, -20), S(-15,   0), S(-20,   0), S(-20,   0), S(-15,   0), S(-20, -20), S(-10, -50),
+    S( 20, -50), S( 11, -20), S(-10, -20), S(-10, -20), S(-10, -20), S(-10, -20), S( 12, -20), S( 20, -50),
+    S( 15, -70), S( 25, -50), S(  3, -50), S( -5, -50), S( -5, -50), S(  5, -50), S( 28, -50), S( 18, -70),
 };
 
-static const int mobilityBonus[2][NB_PIECES] = {
-    0, 1, 4, 3, 1,-2,
-    0, 1, 3, 2, 2, 0,
+static const Score mobilityBonus[NB_PIECES] = {
+    S(0, 0), S(1, 1), S(4, 3), S(3, 2), S(1, 2), S(-2, 0),
 };
 
-static const int kingAttackBonus[2][NB_PIECES] = {
-     0,  1,  2,  3,  5,  0,
-     0,  0,  0,  0,  2,  0,
+static const Score kingAttackBonus[NB_PIECES] = {
+    S(0, 0), S(1, 0), S(2, 0), S(3, 0), S(5, 2), S(0, 0),
 };
 
-static const int passedPawnBonus[2][8] = {
-    0,   5,   5,  15,  25,  45,  90, 0,
-    0,  18,  18,  30,  45,  80, 120, 0,
+static const Score passedPawnBonus[8] = {
+    S(0, 0), S(5, 18), S(5, 18), S(15, 30), S(25, 45), S(45, 80), S(90, 120), S(0, 0),
 };
 
-#define BISHOP_PAIR_BONUS 30
-#define CASTLE_BONUS 20
+#define BISHOP_PAIR_BONUS S(30, 30)
+#define CASTLE_BONUS S(20, 0)
 #define STM_BONUS 9
 
-#define ISOLATED_PAWN_PENALTY 12
-#define DOUBLED_PAWN_PENALTY_MG 10
-#define DOUBLED_PAWN_PENALTY_EG 35
+#define ISOLATED_PAWN_PENALTY S(12, 12)
+#define DOUBLED_PAWN_PENALTY S(10, 35)
+#define BACKWARD_PAWN_PENALTY S(8, 6)
+#define CONNECTED_PAWN_BONUS S(6, 4)
 
 // Game phases
 enum { middlegame, endgame };
@@ -161,5 +112,87 @@ enum { middlegame, endgame };
 #define ROOK_PHASE 22
 #define QUEEN_PHASE 44
 
-int evaluate(Board *board);
-void initPawnMasks();
+static const int PhaseValues[NB_PIECES] = {
+    0, KNIGHT_PHASE, BISHOP_PHASE, ROOK_PHASE, QUEEN_PHASE, 0
+};
+
+// Material and PSQT combined for each colored piece (see toPiece()),
+// flipped for white and negated for black, so the board can keep a
+// running sum as pieces come and go
+extern Score PSQTScores[2 * NB_PIECES][64];
+
+// Pawn hash table
+// Pawn structure rarely changes between nodes, so each search thread
+// caches the pawn scores keyed by the board's pawn hash
+#define PAWN_HASH_SIZE 16384 // Must be a power of 2
+
+typedef struct {
+    U64 pawnHash;
+    Score score; // From white's perspective
+} PawnHashEntry;
+
+typedef struct {
+    PawnHashEntry entries[PAWN_HASH_SIZE];
+} PawnHashTable;
+
+// Evaluation cache
+// Direct mapped cache of full static evaluations keyed by the board hash,
+// mostly hit by quiescence nodes which never probe the main hash table
+#define EVAL_CACHE_SIZE 16384 // Must be a power of 2
+
+// Marks a missing static eval, e.g. in a hash entry
+#define EVAL_NONE INT16_MIN
+
+typedef struct {
+    U64 hash;
+    int eval;
+} EvalCacheEntry;
+
+typedef struct {
+    EvalCacheEntry entries[EVAL_CACHE_SIZE];
+} EvalCache;
+
+// Evaluation trace
+// Records how many times each weight was added for each side, so the
+// hand written evaluation can be rebuilt as a sum of coefficients times
+// weights. Used by the tuner (see tuner/tuner.c) and the 'eval' command.
+// Every term field is a list of [WHITE, BLACK] pairs, and together they
+// make up NB_TRACE_TERMS terms in the order below.
+typedef struct {
+    int pieceValues[NB_PIECES][2];
+    int psqt[NB_PIECES][64][2];
+    int mobility[NB_PIECES][2];
+    int kingAttacks[NB_PIECES][2];
+    int passedPawn[8][2];
+    int isolatedPawn[2];
+    int doubledPawn[2];
+    int backwardPawn[2];
+    int connectedPawn[2];
+    int bishopPair[2];
+    int stm[2];
+
+    int phase;
+    int eval; // From white's perspective
+} EvalTrace;
+
+#define NB_TRACE_TERMS ((int)(offsetof(EvalTrace, phase) / sizeof(int[2])))
+
+// A run of terms sharing one EvalTrace field
+typedef struct {
+    const char *name;
+    int count;
+} TraceGroup;
+
+#define NB_TRACE_GROUPS 11
+extern const TraceGroup traceGroups[NB_TRACE_GROUPS];
+
+int evaluate(Board *board, PawnHashTable *pawnTable);
+int cachedEvaluate(Board *board, EvalCache *evalCache, PawnHashTable *pawnTable);
+void initPSQT();
+int materialPSQTIsValid(Board *board);
+
+int traceEvaluation(Board *board, EvalTrace *trace);
+int traceEvaluations(char **fens, int count, EvalTrace *traces);
+int traceCoefficient(const EvalTrace *trace, int term);
+void traceWeights(Score weights[NB_TRACE_TERMS]);
+void printEvaluation(Board *board);
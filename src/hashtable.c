@@ -1,97 +1,392 @@
 #include "hashtable.h"
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #include "bitboards.h"
 #include "board.h"
 #include "move.h"
 #include "search.h"
+#include "threads.h"
 
 // Global variable :skull:
 HashTable hashTable;
 
-void updateHashAge() { hashTable.age++; }
+// Huge page size on x86-64 Linux
+#define HUGE_PAGE_SIZE (2 * 0x100000)
 
+void updateHashAge(HashTable *table) { table->age = (table->age + 1) & HASH_AGE_MASK; }
+
+// Each clearing thread zeroes its own slice of the table
+typedef struct {
+    HashBucket *start;
+    uint64_t count;
+} ClearSlice;
+
+static void *clearSlice(void *arg) {
+    ClearSlice *slice = (ClearSlice *)arg;
+    memset(slice->start, 0, slice->count * sizeof(HashBucket));
+    return NULL;
+}
+
+// Empties the table
 void clearHashTable() {
-    // Loop through the hash entries, setting all the values to empty
-    for (int i = 0; i < hashTable.count; i++) {
-        // Clear entry
-        hashTable.entries[i].hashKey = 0ULL;
-        hashTable.entries[i].bestMove = NO_MOVE;
-        hashTable.entries[i].depth = 0;
-        hashTable.entries[i].score = 0;
-        hashTable.entries[i].flag = 0;
-        hashTable.entries[i].age = 0;
+    hashTable.age = 0;
+
+#ifdef __linux__
+    // Dropping the pages of an anonymous mapping hands back zero pages on the
+    // next touch, which is instant however big the table is. A mapped hash
+    // file would come back with the file's contents instead, so that one is
+    // cleared by hand below
+    if (hashTable.anonymous && madvise(hashTable.memory, hashTable.memorySize, MADV_DONTNEED) == 0)
+        return;
+#endif
+
+    // Split across every core, whatever the search uses
+    int count = MIN(MAX((int)sysconf(_SC_NPROCESSORS_ONLN), 1), MAX_THREADS);
+    pthread_t handles[MAX_THREADS];
+    ClearSlice slices[MAX_THREADS];
+
+    uint64_t sliceSize = hashTable.count / count;
+    for (int i = 0; i < count; i++) {
+        slices[i].start = hashTable.buckets + i * sliceSize;
+        slices[i].count = (i == count - 1) ? hashTable.count - i * sliceSize : sliceSize;
     }
+
+    // The main thread clears the first slice itself
+    for (int i = 1; i < count; i++)
+        pthread_create(&handles[i], NULL, clearSlice, &slices[i]);
+    clearSlice(&slices[0]);
+    for (int i = 1; i < count; i++)
+        pthread_join(handles[i], NULL);
+}
+
+// Empties a small table on the calling thread, e.g. a datagen game's table
+void resetHashTable(HashTable *table) {
+    memset(table->buckets, 0, table->count * sizeof(HashBucket));
+    table->age = 0;
 }
 
-void freeHashTable() { free(hashTable.entries); }
+void releaseHashTable(HashTable *table) {
+    if (table->memory == NULL)
+        return;
 
-double occupiedHashEntries() {
-    int occupied = 0;
-    for (int i = 0; i < hashTable.count; i++) {
-        if (hashTable.entries[i].hashKey != 0ULL)
-            occupied++;
+#ifdef __linux__
+    munmap(table->memory, table->memorySize);
+#else
+    free(table->memory);
+#endif
+
+    table->memory = NULL;
+    table->buckets = NULL;
+    table->count = 0;
+    table->anonymous = false;
+}
+
+void freeHashTable() {
+    releaseHashTable(&hashTable);
+}
+
+// Estimates how full the table is in permille for UCI 'hashfull'
+// Only a fixed prefix of buckets is sampled, and entries from earlier
+// searches count as empty since they are the first to be replaced
+int hashFull() {
+    int sampled = 0;
+    int used = 0;
+    uint64_t buckets = MIN(hashTable.count, 1000 / BUCKET_SIZE);
+
+    for (uint64_t i = 0; i < buckets; i++) {
+        for (int j = 0; j < BUCKET_SIZE; j++) {
+            U64 data = __atomic_load_n(&hashTable.buckets[i].entries[j].data, __ATOMIC_RELAXED);
+            if (data != 0ULL && EntryAge(data) == hashTable.age)
+                used++;
+            sampled++;
+        }
     }
-    return (double)occupied / (double)hashTable.count;
+
+    return used * 1000 / sampled;
+}
+
+// Allocates a zeroed bucket array
+// Fresh memory from the OS is already zero, so nothing is touched here and
+// pages are only faulted in once the search writes to them.
+// On Linux the table is 2 MB aligned and backed by transparent huge pages
+// where possible, since random probes into a big table are mostly TLB misses
+static int allocateBuckets(HashTable *table, uint64_t size) {
+#ifdef __linux__
+    // Over-allocate so we can trim the mapping to a huge page boundary
+    uint64_t hugeSize = (size + HUGE_PAGE_SIZE - 1) & ~(uint64_t)(HUGE_PAGE_SIZE - 1);
+    uint64_t mapSize = hugeSize + HUGE_PAGE_SIZE;
+    char *mapping = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        return 0;
+
+    // Give back the unaligned head and the leftover tail
+    uintptr_t aligned = ((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    uint64_t head = aligned - (uintptr_t)mapping;
+    if (head > 0)
+        munmap(mapping, head);
+    munmap((char *)aligned + hugeSize, mapSize - head - hugeSize);
+
+    // If the kernel says no we just keep normal pages
+    madvise((void *)aligned, hugeSize, MADV_HUGEPAGE);
+
+    table->memory = (void *)aligned;
+    table->memorySize = hugeSize;
+    table->buckets = (HashBucket *)aligned;
+    table->anonymous = true;
+#else
+    // Fallback: calloc'd memory is zeroed, align it by hand so each
+    // bucket sits in a single cache line
+    char *memory = calloc(size + sizeof(HashBucket), 1);
+    if (memory == NULL)
+        return 0;
+
+    uintptr_t aligned = ((uintptr_t)memory + sizeof(HashBucket) - 1) & ~(uintptr_t)(sizeof(HashBucket) - 1);
+    table->memory = memory;
+    table->memorySize = size + sizeof(HashBucket);
+    table->buckets = (HashBucket *)aligned;
+#endif
+
+    return 1;
+}
+
+// Allocates an empty table of sizeMB, returns 0 if there isn't the memory
+int allocateHashTable(HashTable *table, int sizeMB) {
+    releaseHashTable(table);
+
+    // Calculate how many buckets to match the size
+    uint64_t size = (uint64_t)sizeMB * 0x100000;
+    table->count = size / sizeof(HashBucket);
+    table->age = 0;
+
+    // The table comes back already empty
+    if (!allocateBuckets(table, table->count * sizeof(HashBucket))) {
+        table->count = 0;
+        return 0;
+    }
+    return 1;
 }
 
 // Initialises hash table to certain size in MB
 void initHashTable(int sizeMB) {
-    // Calculate how many hash entries to match the size
-    uint64_t size = sizeMB * 0x100000;
-    hashTable.count = size / sizeof(HashEntry);
-    hashTable.count -= 2; // for safety (inherited from VICE)
+    // Check if allocation failed
+    if (!allocateHashTable(&hashTable, sizeMB)) {
+        puts("Hash allocation failed.");
+        puts("Check if you have enough memory");
+        exit(1);
+    }
 
-    // Free hash table
-    free(hashTable.entries);
+    printf("Hash size set to %d MB\n", sizeMB);
+    printf("Number of hash entries: %lu\n", hashTable.count * BUCKET_SIZE);
+}
 
-    // Allocate and clear the table
-    hashTable.entries = (HashEntry *)malloc(hashTable.count * sizeof(HashEntry));
+int saveHashTable(const char *path) {
+    char tempPath[4096];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
 
-    // Check if allocation failed
-    if (hashTable.entries == NULL) {
+    FILE *file = fopen(tempPath, "wb");
+    if (file == NULL) {
+        printf("Could not open '%s' for writing\n", tempPath);
+        return 0;
+    }
+
+    // Header padded out to a full page
+    char header[HASH_FILE_HEADER_SIZE] = {0};
+    HashFileHeader info = {0};
+    memcpy(info.magic, HASH_FILE_MAGIC, sizeof(HASH_FILE_MAGIC));
+    info.version = HASH_FILE_VERSION;
+    info.bucketSize = sizeof(HashBucket);
+    info.count = hashTable.count;
+    info.age = hashTable.age;
+    memcpy(header, &info, sizeof(info));
+
+    int success = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+               && fwrite(hashTable.buckets, sizeof(HashBucket), hashTable.count, file) == hashTable.count;
+    success = (fclose(file) == 0) && success;
+
+    if (!success || rename(tempPath, path) != 0) {
+        remove(tempPath);
+        printf("Failed to save hash table to '%s'\n", path);
+        return 0;
+    }
+
+    printf("Hash table saved to '%s'\n", path);
+    return 1;
+}
+
+// Replaces the table with one saved by saveHashTable()
+// On Linux the file is mapped copy-on-write instead of read, so loading is
+// instant and pages are only read from disk when a probe touches them
+int loadHashTable(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Could not open '%s'\n", path);
+        return 0;
+    }
+
+    // Check this is a hash file we can use
+    HashFileHeader info;
+    if (fread(&info, sizeof(info), 1, file) != 1
+        || memcmp(info.magic, HASH_FILE_MAGIC, sizeof(HASH_FILE_MAGIC)) != 0
+        || info.version != HASH_FILE_VERSION
+        || info.bucketSize != sizeof(HashBucket)
+        || info.count == 0) {
+        printf("'%s' is not a valid hash file\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    // Make sure the file isn't truncated
+    uint64_t fileSize = HASH_FILE_HEADER_SIZE + info.count * sizeof(HashBucket);
+    fseek(file, 0, SEEK_END);
+    if ((uint64_t)ftell(file) < fileSize) {
+        printf("'%s' is truncated\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    freeHashTable();
+
+#ifdef __linux__
+    char *mapping = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    fclose(file);
+    if (mapping == MAP_FAILED) {
+        puts("Hash file mapping failed.");
+        exit(1);
+    }
+
+    // Random access pattern, so don't bother reading ahead
+    madvise(mapping, fileSize, MADV_RANDOM);
+
+    hashTable.memory = mapping;
+    hashTable.memorySize = fileSize;
+    hashTable.buckets = (HashBucket *)(mapping + HASH_FILE_HEADER_SIZE);
+#else
+    if (!allocateBuckets(&hashTable, info.count * sizeof(HashBucket))) {
         puts("Hash allocation failed.");
         puts("Check if you have enough memory");
         exit(1);
     }
 
-    clearHashTable();
+    fseek(file, HASH_FILE_HEADER_SIZE, SEEK_SET);
+    if (fread(hashTable.buckets, sizeof(HashBucket), info.count, file) != info.count) {
+        printf("Failed to read '%s'\n", path);
+        exit(1);
+    }
+    fclose(file);
+#endif
+
+    hashTable.count = info.count;
+    hashTable.age = info.age & HASH_AGE_MASK;
 
-    printf("Hash size set to %d MB\n", sizeMB);
-    printf("Number of hash entries: %lu\n", hashTable.count);
+    printf("Hash table loaded from '%s'\n", path);
+    printf("Hash size set to %lu MB\n", (hashTable.count * sizeof(HashBucket)) / 0x100000);
+    printf("Number of hash entries: %lu\n", hashTable.count * BUCKET_SIZE);
+    return 1;
 }
 
-void hashTableStore(U64 hash, Move bestMove, int depth, int score, int flag) {
-    // Calculate hash index and retrieve corresponding bucket
-    int index = hash % hashTable.count;
-    HashEntry *entry = &hashTable.entries[index];
+// Maps a hash to a bucket with a multiply and shift instead of a modulo,
+// which works for any bucket count and avoids a 64-bit division
+static inline HashBucket *getBucket(HashTable *table, U64 hash) {
+    uint64_t index = ((unsigned __int128)hash * table->count) >> 64;
+    return &table->buckets[index];
+}
+
+static inline U64 packEntry(Move bestMove, int depth, int score, int eval, int flag, int age) {
+    return (U64)bestMove
+         | (U64)(uint16_t)score << 16
+         | (U64)(uint8_t)depth << 32
+         | (U64)flag << 40
+         | (U64)(age & HASH_AGE_MASK) << 42
+         | (U64)(uint16_t)eval << 48;
+}
 
-    entry->hashKey = hash;
-    entry->bestMove = bestMove;
-    entry->depth = depth;
-    entry->score = score;
-    entry->flag = flag;
-    entry->age = hashTable.age;
+// How much an entry is worth keeping, the lowest in a bucket is replaced
+// Deep entries from this search are kept, old entries age out quickly
+static inline int entryWorth(HashTable *table, U64 data) {
+    int relativeAge = (table->age - EntryAge(data)) & HASH_AGE_MASK;
+    return EntryDepth(data) - 8 * relativeAge + (EntryFlag(data) == BOUND_EXACT ? 2 : 0);
 }
 
-int hashTableProbe(U64 hash, Move *hashMove, int *depth, int *score, int *flag) {
-    // Calculate hash index and retrieve corresponding bucket
-    int index = hash % hashTable.count;
-    HashEntry *entry = &hashTable.entries[index];
+void hashTableStore(HashTable *table, U64 hash, Move bestMove, int depth, int score, int eval, int flag) {
+    HashBucket *bucket = getBucket(table, hash);
+    HashEntry *replace = &bucket->entries[0];
+    U64 replaceData = __atomic_load_n(&replace->data, __ATOMIC_RELAXED);
+
+    // Depth is stored in 8 bits
+    depth = MIN(depth, 255);
+
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        HashEntry *entry = &bucket->entries[i];
+        U64 data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+        U64 key = __atomic_load_n(&entry->key, __ATOMIC_RELAXED);
+
+        // Same position, update it in place
+        if ((key ^ data) == hash && data != 0ULL) {
+            // Don't let a shallow bound overwrite a deeper search of this
+            // position unless it is exact or left over from an older search
+            if (flag != BOUND_EXACT && depth + 3 < EntryDepth(data) && EntryAge(data) == table->age)
+                return;
+
+            // Keep the old move if we didn't find one
+            if (bestMove == NO_MOVE)
+                bestMove = EntryMove(data);
+
+            replace = entry;
+            break;
+        }
+
+        // Empty slots are always used first
+        if (data == 0ULL) {
+            replace = entry;
+            break;
+        }
+
+        if (entryWorth(table, data) < entryWorth(table, replaceData)) {
+            replace = entry;
+            replaceData = data;
+        }
+    }
+
+    // Write the key XORed with the data so torn writes can be detected
+    U64 data = packEntry(bestMove, depth, score, eval, flag, table->age);
+
+    // Relaxed atomics compile to plain moves, but stop the compiler from
+    // splitting or merging the accesses
+    __atomic_store_n(&replace->key, hash ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&replace->data, data, __ATOMIC_RELAXED);
+}
+
+int hashTableProbe(HashTable *table, U64 hash, Move *hashMove, int *depth, int *score, int *eval, int *flag) {
+    HashBucket *bucket = getBucket(table, hash);
+
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        HashEntry *entry = &bucket->entries[i];
+
+        // Read each word exactly once, another thread may be writing to it
+        U64 data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+        U64 key = __atomic_load_n(&entry->key, __ATOMIC_RELAXED);
 
-    // Check the first entry
-    if (entry->hashKey == hash) {
-        // Copy data over
-        *hashMove = entry->bestMove;
-        *depth = entry->depth;
-        *score = entry->score;
-        *flag = entry->flag;
+        // A torn or foreign entry fails this check
+        if ((key ^ data) == hash && data != 0ULL) {
+            // Copy data over
+            *hashMove = EntryMove(data);
+            *depth = EntryDepth(data);
+            *score = EntryScore(data);
+            *eval = EntryEval(data);
+            *flag = EntryFlag(data);
 
-        return PROBE_SUCCESS;
+            return PROBE_SUCCESS;
+        }
     }
 
     return PROBE_FAIL;
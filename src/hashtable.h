@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "bitboards.h"
@@ -25,33 +26,100 @@ enum {
 
 };
 
+// Hash size limits in MB
+#define DEFAULT_HASH_MB 256
+#define MAX_HASH_MB 131072
+
 // Probing flags
 enum { PROBE_FAIL, PROBE_SUCCESS };
 
+/*
+    Lockless hash entry (Hyatt's XOR trick)
+
+    Every field is packed into the 64-bit data word, and the key is stored
+    XORed with that data. If two threads write the same entry at once, the
+    key and data of a torn entry no longer match, so the probe just misses
+    instead of returning a move from a different position.
+
+    Data word breakdown
+    0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 1111 1111 1111 1111 | Best move (16 bits)
+    0000 0000 0000 0000 0000 0000 0000 0000 1111 1111 1111 1111 0000 0000 0000 0000 | Score     (16 bits)
+    0000 0000 0000 0000 0000 0000 1111 1111 0000 0000 0000 0000 0000 0000 0000 0000 | Depth     (8 bits)
+    0000 0000 0000 0000 0000 0011 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 | Flag      (2 bits)
+    0000 0000 0000 0000 1111 1100 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 | Age       (6 bits)
+    1111 1111 1111 1111 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 0000 | Static eval (16 bits)
+*/
 typedef struct {
-  U64 hashKey;
-  Move bestMove;
-  int16_t depth;
-  int16_t score;
-  uint8_t age;
-  uint8_t flag;
+  U64 key;  // Zobrist hash ^ data
+  U64 data; // Packed entry
 } HashEntry;
 
+// Entries are grouped into buckets which fill exactly one cache line,
+// so a probe costs at most one cache miss
+#define BUCKET_SIZE 4
 typedef struct {
-  HashEntry *entries;
-  uint64_t count;
+  HashEntry entries[BUCKET_SIZE];
+} HashBucket;
+
+#define HASH_AGE_MASK 0x3F
+
+#define EntryMove(data) ((Move)((data) & 0xFFFF))
+#define EntryScore(data) ((int16_t)(((data) >> 16) & 0xFFFF))
+#define EntryDepth(data) ((int)(((data) >> 32) & 0xFF))
+#define EntryFlag(data) ((int)(((data) >> 40) & 0x3))
+#define EntryAge(data) ((int)(((data) >> 42) & HASH_AGE_MASK))
+#define EntryEval(data) ((int16_t)(((data) >> 48) & 0xFFFF))
+
+typedef struct {
+  HashBucket *buckets;
+  uint64_t count; // Number of buckets
   int age;
+
+  // The raw allocation backing the buckets
+  void *memory;
+  uint64_t memorySize;
+  bool anonymous; // Private anonymous mapping, the kernel can zero it for us
 } HashTable;
 
+// The table shared by every search thread
+extern HashTable hashTable;
+
+/*
+    Hash file layout, used to keep the table between sessions
+
+    [0, 4096)      HashFileHeader, zero padded to one page
+    [4096, ...)    The bucket array exactly as it is in memory
+
+    The buckets start on a page boundary so the file can be mapped
+    straight in as the table. Entries are only meaningful for the same
+    Zobrist keys, which are generated from a fixed seed.
+*/
+#define HASH_FILE_MAGIC "SAINTTT"
+#define HASH_FILE_VERSION 1
+#define HASH_FILE_HEADER_SIZE 4096
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t bucketSize;
+  uint64_t count;
+  int32_t age;
+} HashFileHeader;
+
 // Hash table functions
 void initHashTable(int sizeMB);
 void freeHashTable();
+int allocateHashTable(HashTable *table, int sizeMB);
+void releaseHashTable(HashTable *table);
+void resetHashTable(HashTable *table);
 void clearHashTable();
-double occupiedHashEntries();
+int hashFull();
+int saveHashTable(const char *path);
+int loadHashTable(const char *path);
 
 // For use in game
-void hashTableStore(U64 hash, Move bestMove, int depth, int score, int flag);
-int hashTableProbe(U64 hash, Move *hashMove, int *depth, int *score, int *flag);
-void updateHashAge();
+void hashTableStore(HashTable *table, U64 hash, Move bestMove, int depth, int score, int eval, int flag);
+int hashTableProbe(HashTable *table, U64 hash, Move *hashMove, int *depth, int *score, int *eval, int *flag);
+void updateHashAge(HashTable *table);
 
 // int storePVLine(PV *line, Board *board, int depth);
@@ -4,7 +4,9 @@
 #include <stdio.h>
 
 #include "board.h"
+#include "eval.h"
 #include "move.h"
+#include "nnue.h"
 #include "zobrist.h"
 
 static inline void RemoveWhiteCastling(Board *board) {
@@ -113,6 +115,7 @@ void makeNullMove(Board *board) {
     undo->epSquare = board->epSquare;
     undo->fiftyMove = board->fiftyMove;
     undo->hash = board->hash;
+    undo->pawnHash = board->pawnHash;
     undo->move = NO_MOVE;
 
     // Update side to move and ply
@@ -128,6 +131,9 @@ void makeNullMove(Board *board) {
     // Null moves are irreversible right?
     board->fiftyMove = 0;
 
+    if (useNNUE)
+        nnueMakeNullMove(board);
+
     assert(board->hash == generateHash(board));
 }
 
@@ -142,6 +148,7 @@ void undoNullMove(Board *board) {
     board->epSquare = undo->epSquare;
     board->fiftyMove = undo->fiftyMove;
     board->hash = undo->hash;
+    board->pawnHash = undo->pawnHash;
 
     assert(board->hash == generateHash(board));
 }
@@ -162,6 +169,9 @@ void undoMove(Board *board, Move move) {
     board->epSquare = undo->epSquare;
     board->fiftyMove = undo->fiftyMove;
     board->hash = undo->hash;
+    board->pawnHash = undo->pawnHash;
+    board->materialPSQT = undo->materialPSQT;
+    board->phase = undo->phase;
 
     int capturedPiece = undo->capturedPiece;
     int movedPiece = undo->movedPiece;
@@ -204,9 +214,11 @@ void undoMove(Board *board, Move move) {
     }
 
     assert(board->hash == generateHash(board));
+    assert(board->pawnHash == generatePawnHash(board));
+    assert(materialPSQTIsValid(board));
 }
 
-// return 1 if currently in check, 0 if not
+// return 1 if the side which just moved left its king in check, 0 if not
 int moveWasIllegal(Board *board) {
     // If the king is attacked, return 1
     if (isSquareAttacked(
@@ -217,9 +229,9 @@ int moveWasIllegal(Board *board) {
         return 0;
 }
 
-// Makes pseudolegal move on the board, returns 1 if it was legal, 0 if it
-// wasn't
-int makeMove(Board *board, Move move) {
+// Makes a legal move on the board
+// Legality is the move generator's job, so nothing is checked here
+void makeMove(Board *board, Move move) {
     // Extract information from the move
     int from = MoveFrom(move);
     int to = MoveTo(move);
@@ -234,6 +246,9 @@ int makeMove(Board *board, Move move) {
     undo->fiftyMove = board->fiftyMove;
     undo->movedPiece = movedPiece;
     undo->hash = board->hash;
+    undo->pawnHash = board->pawnHash;
+    undo->materialPSQT = board->materialPSQT;
+    undo->phase = board->phase;
     undo->capturedPiece = NO_PIECE;
     undo->move = move;
 
@@ -353,11 +368,12 @@ int makeMove(Board *board, Move move) {
     board->side = !board->side;
     board->hash ^= SideKey;
 
+    if (useNNUE)
+        nnueMakeMove(board, move);
+
     assert(board->hash == generateHash(board));
+    assert(board->pawnHash == generatePawnHash(board));
+    assert(materialPSQTIsValid(board));
 
-    // If we're in check, that move was illegal
-    if (moveWasIllegal(board))
-        return 0;
-    else
-        return 1;
+    assert(!moveWasIllegal(board));
 }
@@ -2,7 +2,7 @@
 
 #include "board.h"
 
-int makeMove(Board *board, Move move);
+void makeMove(Board *board, Move move);
 void undoMove(Board *board, Move move);
 void makeNullMove(Board *board);
 void undoNullMove(Board *board);
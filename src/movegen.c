@@ -8,19 +8,7 @@
 #include "makemove.h"
 #include "move.h"
 
-static inline void addNormalMoves(MoveList *moves, int fromSq, U64 attacks, Board *board) {
-    int toSq;
-    while (attacks) {
-        toSq = poplsb(&attacks);
-        if (board->squares[toSq] == EMPTY)
-            moves->list[moves->count] = ConstructMove(fromSq, toSq, QUIET_FLAG);
-        else
-            moves->list[moves->count] = ConstructMove(fromSq, toSq, CAPTURE_FLAG);
-        moves->count++;
-    }
-}
-
-static inline void addCaptures(MoveList *moves, int fromSq, U64 captures, Board *board) {
+static inline void addCaptures(MoveList *moves, int fromSq, U64 captures) {
     int toSq;
     while (captures) {
         toSq = poplsb(&captures);
@@ -29,17 +17,12 @@ static inline void addCaptures(MoveList *moves, int fromSq, U64 captures, Board
     }
 }
 
-static inline void addPawnCaptures(int epSquare, MoveList *moves, int fromSq, U64 attacks) {
+static inline void addQuiets(MoveList *moves, int fromSq, U64 quiets) {
     int toSq;
-    while (attacks) {
-        toSq = poplsb(&attacks);
-        if (toSq == epSquare) {
-            moves->list[moves->count] = ConstructMove(fromSq, toSq, EP_FLAG);
-            moves->count++;
-        } else {
-            moves->list[moves->count] = ConstructMove(fromSq, toSq, CAPTURE_FLAG);
-            moves->count++;
-        }
+    while (quiets) {
+        toSq = poplsb(&quiets);
+        moves->list[moves->count] = ConstructMove(fromSq, toSq, QUIET_FLAG);
+        moves->count++;
     }
 }
 
@@ -92,75 +75,140 @@ static inline void addPromotionCaptures(MoveList *moves, U64 captures, int from)
     }
 }
 
-static inline void generatePawnMoves(MoveList *moves, Board *board) {
-    U64 doublePushRanks[2] = {RANK_2, RANK_7};
-    U64 promotionRanks[2] = {RANK_8, RANK_1};
-
-    U64 pawns = board->pieces[PAWN] & board->colors[board->side];
-    U64 emptySquares = ~(board->colors[BOTH]);
-    U64 pushes, doublePushes;
-    U64 attacks;
-
-    if (board->side == WHITE) {
-        // Generate pawn pushes via bitshifting
-        pushes = (pawns << 8) & emptySquares;
+// Everything the generators need to only produce legal moves
+typedef struct {
+    int kingSq;
+    U64 checkers;
+    U64 pinned;    // our pieces which can only move along the line to our king
+    U64 checkMask; // squares our non-king moves have to land on
+    U64 unsafe;    // squares our king can't move to
+} LegalInfo;
+
+static inline void initLegalInfo(LegalInfo *info, Board *board) {
+    AttackInfo *attacks = getAttackInfo(board);
+
+    info->kingSq = getlsb(board->pieces[KING] & board->colors[board->side]);
+    info->checkers = attacks->checkers;
+    info->pinned = attacks->pinned;
+    info->unsafe = attacks->attacked[!board->side];
+
+    // In check we have to capture the checker or block it, and in double
+    // check only the king can move
+    if (info->checkers == 0ULL)
+        info->checkMask = ~0ULL;
+    else if (popCount(info->checkers) == 1)
+        info->checkMask = info->checkers | squaresBetween(info->kingSq, getlsb(info->checkers));
+    else
+        info->checkMask = 0ULL;
+
+    // The attack maps were made with our king on the board, so a slider
+    // checking us also attacks the squares behind the king along its line
+    U64 sliders = info->checkers & ~(board->pieces[PAWN] | board->pieces[KNIGHT]);
+    while (sliders) {
+        int checker = poplsb(&sliders);
+        info->unsafe |= lineThrough(info->kingSq, checker) & ~(1ULL << checker);
+    }
+}
 
-        // Double pushes
-        doublePushes = ((pawns & doublePushRanks[board->side]) << 16) & emptySquares;
+// Squares a non-king piece on from can move to without exposing our king
+static inline U64 legalTargets(LegalInfo *info, int from) {
+    if (testBit(info->pinned, from))
+        return info->checkMask & lineThrough(info->kingSq, from);
+    return info->checkMask;
+}
 
-        // Remove double pushes blocked
-        doublePushes = doublePushes & emptySquares << 8;
-    } else {
-        // Generate pawn pushes via bitshifting
-        pushes = (pawns >> 8) & emptySquares;
+// Filters king targets down to the squares which aren't attacked
+static inline U64 safeKingTargets(LegalInfo *info, U64 targets) {
+    return targets & ~info->unsafe;
+}
 
-        // Double pushes
-        doublePushes = ((pawns & doublePushRanks[board->side]) >> 16) & emptySquares;
+// En passant removes two pieces from a line at once, so it's easiest to just
+// play it out on the occupancy and look at the king
+static inline int epIsLegal(Board *board, LegalInfo *info, int from, int to) {
+    int capturedSq = to ^ 8;
+    U64 occupied = (board->colors[BOTH] ^ (1ULL << from) ^ (1ULL << capturedSq)) | (1ULL << to);
+    U64 attackers = allAttackersToSquare(board, occupied, info->kingSq)
+                  & board->colors[!board->side] & ~(1ULL << capturedSq);
+    return attackers == 0ULL;
+}
 
-        // Remove double pushes blocked
-        doublePushes = doublePushes & emptySquares >> 8;
-    }
-    addPawnPushes(moves, doublePushes, board->side, 2);
+// Pawns which can push: unpinned ones, and pinned ones on the king's file
+// since they stay on the pin
+static inline U64 pushablePawns(Board *board, LegalInfo *info) {
+    U64 pawns = board->pieces[PAWN] & board->colors[board->side];
+    U64 kingFile = 0x0101010101010101ULL << fileOf(info->kingSq);
+    return pawns & (~info->pinned | kingFile);
+}
 
-    // Sort pushes between promotions and quiet pushes before adding
-    U64 quietPushes = pushes & ~promotionRanks[board->side];
-    addPawnPushes(moves, quietPushes, board->side, 1);
-    U64 promotionPushes = pushes & promotionRanks[board->side];
-    addPromotionPushes(moves, promotionPushes, board->side);
+static inline void generatePawnNoisy(MoveList *moves, Board *board, LegalInfo *info) {
+    // Generates pawn captures and promotions
 
-    // Generate pawn captures, with promotions and en passant
+    U64 pawns = board->pieces[PAWN] & board->colors[board->side];
+    U64 emptySquares = ~(board->colors[BOTH]);
+    U64 promotionRanks[2] = {RANK_8, RANK_1};
 
-    // Attackable squares = enemy pieces or en passant square
-    U64 attackable;
-    attackable = board->colors[!board->side];
-    if (board->epSquare != NO_SQ) {
-        setBit(&attackable, board->epSquare);
-    }
+    // Generate promotions
+    U64 pushable = pushablePawns(board, info);
+    U64 promotions;
+    if (board->side == WHITE)
+        promotions = (pushable << 8) & emptySquares & promotionRanks[WHITE];
+    else
+        promotions = (pushable >> 8) & emptySquares & promotionRanks[BLACK];
+    addPromotionPushes(moves, promotions & info->checkMask, board->side);
 
+    // Captures, with or without promotion
     while (pawns) {
         int from = poplsb(&pawns);
-        attacks = pawnAttacks(board->side, from) & attackable;
-        // Promotions
-        if (attacks & promotionRanks[board->side]) {
+        U64 attacks = pawnAttacks(board->side, from) & board->colors[!board->side] & legalTargets(info, from);
+
+        if (attacks & promotionRanks[board->side])
             addPromotionCaptures(moves, attacks, from);
-        }
-        // Normal captures
-        else {
-            addPawnCaptures(board->epSquare, moves, from, attacks);
+        else
+            addCaptures(moves, from, attacks);
+    }
+
+    // En passant
+    if (board->epSquare != NO_SQ) {
+        U64 epCapturers = pawnAttacks(!board->side, board->epSquare) & board->pieces[PAWN] & board->colors[board->side];
+        while (epCapturers) {
+            int from = poplsb(&epCapturers);
+            if (epIsLegal(board, info, from, board->epSquare)) {
+                moves->list[moves->count] = ConstructMove(from, board->epSquare, EP_FLAG);
+                moves->count++;
+            }
         }
     }
 }
 
-static inline void generateKingMoves(MoveList *moves, Board *board) {
-    // Get the king's square
-    int kingSq = getlsb(board->pieces[KING] & board->colors[board->side]);
-    U64 attacks = kingAttacks(kingSq) & ~board->colors[board->side];
+static inline void generatePieceCaptures(MoveList *moves, Board *board, LegalInfo *info) {
+    U64 ours = board->colors[board->side];
+    U64 theirs = board->colors[!board->side];
+
+    // Knights, a pinned knight can never move
+    U64 knights = board->pieces[KNIGHT] & ours & ~info->pinned;
+    while (knights) {
+        int from = poplsb(&knights);
+        addCaptures(moves, from, knightAttacks(from) & theirs & info->checkMask);
+    }
+
+    // Bishops and queens
+    U64 bishops = (board->pieces[BISHOP] | board->pieces[QUEEN]) & ours;
+    while (bishops) {
+        int from = poplsb(&bishops);
+        addCaptures(moves, from, Bmagic(from, board->colors[BOTH]) & theirs & legalTargets(info, from));
+    }
 
-    // Add king attacks from that square
-    addNormalMoves(moves, kingSq, attacks, board);
+    // Rooks and queens
+    U64 rooks = (board->pieces[ROOK] | board->pieces[QUEEN]) & ours;
+    while (rooks) {
+        int from = poplsb(&rooks);
+        addCaptures(moves, from, Rmagic(from, board->colors[BOTH]) & theirs & legalTargets(info, from));
+    }
+}
 
-    // If in check, break out and don't check castling
-    if (isSquareAttacked(board, board->side, kingSq))
+static inline void generateCastling(MoveList *moves, Board *board, LegalInfo *info) {
+    // Can't castle out of check
+    if (info->checkers)
         return;
 
     // Add castling moves
@@ -168,14 +216,14 @@ static inline void generateKingMoves(MoveList *moves, Board *board) {
         // White's Kingside Castling
         if (board->castlePerm & CASTLE_WK) {
             if ((board->colors[BOTH] & CASTLE_MASK_WK) == 0ull) {
-                if (!isSquareAttacked(board, WHITE, F1) && !isSquareAttacked(board, WHITE, G1))
+                if (!testBit(info->unsafe, F1) && !testBit(info->unsafe, G1))
                     addCastleMove(moves, E1, G1);
             }
         }
         // White's Queenside Castling
         if (board->castlePerm & CASTLE_WQ) {
             if ((board->colors[BOTH] & CASTLE_MASK_WQ) == 0ull) {
-                if (!isSquareAttacked(board, WHITE, D1) && !isSquareAttacked(board, WHITE, C1))
+                if (!testBit(info->unsafe, D1) && !testBit(info->unsafe, C1))
                     addCastleMove(moves, E1, C1);
             }
         }
@@ -183,190 +231,226 @@ static inline void generateKingMoves(MoveList *moves, Board *board) {
         // Black's Kingside Castling
         if (board->castlePerm & CASTLE_BK) {
             if ((board->colors[BOTH] & CASTLE_MASK_BK) == 0ull) {
-                if (!isSquareAttacked(board, BLACK, F8) && !isSquareAttacked(board, BLACK, G8))
+                if (!testBit(info->unsafe, F8) && !testBit(info->unsafe, G8))
                     addCastleMove(moves, E8, G8);
             }
         }
         // Black's Queenside Castling
         if (board->castlePerm & CASTLE_BQ) {
             if ((board->colors[BOTH] & CASTLE_MASK_BQ) == 0ull) {
-                if (!isSquareAttacked(board, BLACK, D8) && !isSquareAttacked(board, BLACK, C8))
+                if (!testBit(info->unsafe, D8) && !testBit(info->unsafe, C8))
                     addCastleMove(moves, E8, C8);
             }
         }
     }
 }
 
-static inline void generateKnightMoves(MoveList *moves, Board *board) {
-    // Get knights on our side
-    U64 knights = board->pieces[KNIGHT] & board->colors[board->side];
-    U64 attacks;
+static inline void generatePawnQuiets(MoveList *moves, Board *board, LegalInfo *info) {
+    // Generates pawn pushes which aren't promotions
+    U64 promotionRanks[2] = {RANK_8, RANK_1};
 
-    // Loop through all of them, looking up their attacks
-    while (knights) {
-        int from = poplsb(&knights);
+    U64 pawns = pushablePawns(board, info);
+    U64 emptySquares = ~(board->colors[BOTH]);
+    U64 pushes, doublePushes;
 
-        attacks = knightAttacks(from) & ~board->colors[board->side];
-        addNormalMoves(moves, from, attacks, board);
+    // Double pushes go through the square a single push lands on
+    if (board->side == WHITE) {
+        pushes = (pawns << 8) & emptySquares;
+        doublePushes = ((pushes & RANK_3) << 8) & emptySquares;
+    } else {
+        pushes = (pawns >> 8) & emptySquares;
+        doublePushes = ((pushes & RANK_6) >> 8) & emptySquares;
     }
+
+    addPawnPushes(moves, doublePushes & info->checkMask, board->side, 2);
+    addPawnPushes(moves, pushes & ~promotionRanks[board->side] & info->checkMask, board->side, 1);
 }
 
-static inline void generateSlidingMoves(MoveList *moves, Board *board) {
+static inline void generatePieceQuiets(MoveList *moves, Board *board, LegalInfo *info) {
+    U64 emptySquares = ~(board->colors[BOTH]);
+    U64 ours = board->colors[board->side];
+
+    // Knights
+    U64 knights = board->pieces[KNIGHT] & ours & ~info->pinned;
+    while (knights) {
+        int from = poplsb(&knights);
+        addQuiets(moves, from, knightAttacks(from) & emptySquares & info->checkMask);
+    }
+
     // Bishops and queens
-    U64 attacks;
-    U64 bishops = (board->pieces[BISHOP] | board->pieces[QUEEN]) &
-                                board->colors[board->side];
+    U64 bishops = (board->pieces[BISHOP] | board->pieces[QUEEN]) & ours;
     while (bishops) {
         int from = poplsb(&bishops);
-
-        U64 attacks =
-                Bmagic(from, board->colors[BOTH]) & ~board->colors[board->side];
-        addNormalMoves(moves, from, attacks, board);
+        addQuiets(moves, from, Bmagic(from, board->colors[BOTH]) & emptySquares & legalTargets(info, from));
     }
 
     // Rooks and queens
-    U64 rooks = (board->pieces[ROOK] | board->pieces[QUEEN]) & board->colors[board->side];
+    U64 rooks = (board->pieces[ROOK] | board->pieces[QUEEN]) & ours;
     while (rooks) {
         int from = poplsb(&rooks);
-
-        U64 attacks = Rmagic(from, board->colors[BOTH]) & ~board->colors[board->side];
-        addNormalMoves(moves, from, attacks, board);
+        addQuiets(moves, from, Rmagic(from, board->colors[BOTH]) & emptySquares & legalTargets(info, from));
     }
 }
 
-void generatePseudoLegalMoves(MoveList *moves, Board *board) {
-    moves->count = 0;
+void generateNoisyMoves(MoveList *moves, Board *board) {
+    // By our definition, noisy moves are captures and promotions
+    // Only legal ones are generated
 
-    // If double check we exit early
-    U64 kingCheckers = attackersToKingSquare(board);
-    int checkerCount = popCount(kingCheckers);
-    if (checkerCount >= 2) {
-        // Just generate king moves
-        generateKingMoves(moves, board);
-        return;
-    }
+    LegalInfo info;
+    initLegalInfo(&info, board);
 
-    // Pawns
-    generatePawnMoves(moves, board);
+    moves->count = 0;
 
-    // Sliders
-    generateSlidingMoves(moves, board);
+    // In double check only the king can move
+    if (popCount(info.checkers) < 2) {
+        generatePawnNoisy(moves, board, &info);
+        generatePieceCaptures(moves, board, &info);
+    }
 
-    // Knights and King
-    generateKnightMoves(moves, board);
-    generateKingMoves(moves, board);
+    U64 kingCaptures = kingAttacks(info.kingSq) & board->colors[!board->side];
+    addCaptures(moves, info.kingSq, safeKingTargets(&info, kingCaptures));
 }
 
-static inline void generatePawnNoisy(MoveList *moves, Board *board) {
-    // Generates pawn captures and promotions
+void generateQuietMoves(MoveList *moves, Board *board) {
+    // Everything generateNoisyMoves() doesn't generate:
+    // non-promotion pawn pushes, non-captures and castling
+    // Only legal ones are generated
 
-    U64 pawns = board->pieces[PAWN] & board->colors[board->side];
-    U64 emptySquares = ~(board->pieces[BOTH]);
-    U64 attacks;
-    U64 promotionRanks[2] = {RANK_8, RANK_1};
+    LegalInfo info;
+    initLegalInfo(&info, board);
 
-    // Generate promotions
-    U64 promotions;
-    if (board->side == WHITE)
-        promotions = (pawns << 8) & emptySquares & promotionRanks[WHITE];
-    else
-        promotions = (pawns >> 8) & emptySquares & promotionRanks[BLACK];
-    addPromotionPushes(moves, promotions, board->side);
+    moves->count = 0;
 
-    // Attackable squares = enemy pieces or en passant square
-    U64 attackable;
-    attackable = board->colors[!board->side];
-    if (board->epSquare != NO_SQ) {
-        setBit(&attackable, board->epSquare);
+    // In double check only the king can move
+    if (popCount(info.checkers) < 2) {
+        generatePawnQuiets(moves, board, &info);
+        generatePieceQuiets(moves, board, &info);
+        generateCastling(moves, board, &info);
     }
 
-    while (pawns) {
-        int from = poplsb(&pawns);
-        attacks = pawnAttacks(board->side, from) & attackable;
-
-        // Promotions
-        if (attacks & promotionRanks[board->side]) {
-            addPromotionCaptures(moves, attacks, from);
-        }
-        // Normal captures
-        else {
-            addPawnCaptures(board->epSquare, moves, from, attacks);
-        }
-    }
+    U64 kingQuiets = kingAttacks(info.kingSq) & ~board->colors[BOTH];
+    addQuiets(moves, info.kingSq, safeKingTargets(&info, kingQuiets));
 }
 
-static inline void generateLeapingCaptures(MoveList *moves, Board *board) {
-    // Get knights on our side
-    U64 captures;
-    U64 knights = board->pieces[KNIGHT] & board->colors[board->side];
-
-    // Loop through all of them, looking up their attacks
-    while (knights) {
-        int from = poplsb(&knights);
-        captures = knightAttacks(from) & board->colors[!board->side];
-
-        addCaptures(moves, from, captures, board);
-    }
+void generateLegalMoves(MoveList *moves, Board *board) {
+    // Noisy moves followed by quiets
+    MoveList quiets;
+    generateNoisyMoves(moves, board);
+    generateQuietMoves(&quiets, board);
 
-    // Get king captures
-    int kingSq = getlsb(board->pieces[KING] & board->colors[board->side]);
-    U64 kingCaptures = kingAttacks(kingSq) & board->colors[!board->side];
-    addCaptures(moves, kingSq, kingCaptures, board);
+    for (int i = 0; i < quiets.count; i++)
+        moves->list[moves->count++] = quiets.list[i];
 }
 
-static inline void generateSlidingCaptures(MoveList *moves, Board *board) {
-    // Bishops and queens
-    U64 attacks;
-    U64 bishops = (board->pieces[BISHOP] | board->pieces[QUEEN]) & board->colors[board->side];
-    while (bishops) {
-        int from = poplsb(&bishops);
-
-        // Filtering for captures
-        U64 attacks = Bmagic(from, board->colors[BOTH]) & board->colors[!board->side];
+// Checks a move against the board without generating anything
+// Moves from the hash table or killers might come from a different position,
+// so everything the move claims (piece, flags, path) has to be true here
+int isPseudoLegal(Board *board, Move move) {
+    int from = MoveFrom(move);
+    int to = MoveTo(move);
+    int flags = MoveFlags(move);
+    int piece = board->squares[from];
+    U64 ours = board->colors[board->side];
+    U64 theirs = board->colors[!board->side];
+    U64 promotionRanks[2] = {RANK_8, RANK_1};
 
-        addCaptures(moves, from, attacks, board);
+    if (move == NO_MOVE || !testBit(ours, from) || testBit(ours, to))
+        return 0;
+
+    // Flags which no move uses
+    if (flags == 0b0010 || flags == 0b0011 || flags == 0b0101 || flags == 0b0111)
+        return 0;
+
+    if (IsCastling(move)) {
+        if (board->side == WHITE) {
+            if (from != E1)
+                return 0;
+            if (to == G1)
+                return (board->castlePerm & CASTLE_WK) && !(board->colors[BOTH] & CASTLE_MASK_WK);
+            if (to == C1)
+                return (board->castlePerm & CASTLE_WQ) && !(board->colors[BOTH] & CASTLE_MASK_WQ);
+        } else {
+            if (from != E8)
+                return 0;
+            if (to == G8)
+                return (board->castlePerm & CASTLE_BK) && !(board->colors[BOTH] & CASTLE_MASK_BK);
+            if (to == C8)
+                return (board->castlePerm & CASTLE_BQ) && !(board->colors[BOTH] & CASTLE_MASK_BQ);
+        }
+        return 0;
     }
 
-    // Rooks and queens
-    U64 rooks = (board->pieces[ROOK] | board->pieces[QUEEN]) & board->colors[board->side];
-    while (rooks) {
-        int from = poplsb(&rooks);
-
-        // Filtering for captures
-        U64 attacks = Rmagic(from, board->colors[BOTH]) & board->colors[!board->side];
-        addCaptures(moves, from, attacks, board);
+    if (IsEnpass(move))
+        return piece == PAWN && to == board->epSquare && testBit(pawnAttacks(board->side, from), to);
+
+    // The capture flag has to agree with the board
+    if (IsCapture(move) != testBit(theirs, to))
+        return 0;
+
+    if (piece == PAWN) {
+        // Pawns promote exactly when they reach the last rank
+        if (IsPromotion(move) != testBit(promotionRanks[board->side], to))
+            return 0;
+
+        if (IsCapture(move))
+            return testBit(pawnAttacks(board->side, from), to);
+
+        int forward = board->side == WHITE ? 8 : -8;
+        int startRank = board->side == WHITE ? 1 : 6;
+        if (to == from + forward)
+            return board->squares[to] == EMPTY;
+        if (to == from + 2 * forward)
+            return rankOf(from) == startRank
+                && board->squares[from + forward] == EMPTY && board->squares[to] == EMPTY;
+        return 0;
     }
-}
 
-void generateNoisyMoves(MoveList *moves, Board *board) {
-    // By our definition, noisy moves are captures and promotions
-    // Last I checked, this function segfaults so I have to come back here
-    // TODO: fix this its still not working?
+    if (IsPromotion(move))
+        return 0;
+
+    switch (piece) {
+    case KNIGHT:
+        return testBit(knightAttacks(from), to);
+    case BISHOP:
+        return testBit(Bmagic(from, board->colors[BOTH]), to);
+    case ROOK:
+        return testBit(Rmagic(from, board->colors[BOTH]), to);
+    case QUEEN:
+        return testBit(Bmagic(from, board->colors[BOTH]) | Rmagic(from, board->colors[BOTH]), to);
+    case KING:
+        return testBit(kingAttacks(from), to);
+    }
 
-    moves->count = 0;
-    generatePawnNoisy(moves, board);
-    generateLeapingCaptures(moves, board);
-    generateSlidingCaptures(moves, board);
+    return 0;
 }
 
-void generateLegalMoves(MoveList *moves, Board *board) {
-    // NOTE: Should not be used, it's highly inefficient
-    // Generally we just check legality as we make the moves
+// Checks that a pseudo legal move doesn't leave our king in check
+// Moves from the generators are always legal, this is for moves which come
+// from elsewhere e.g. the hash table
+int isLegal(Board *board, Move move) {
+    LegalInfo info;
+    initLegalInfo(&info, board);
 
-    MoveList tempMoves;
-    generatePseudoLegalMoves(&tempMoves, board);
+    int from = MoveFrom(move);
+    int to = MoveTo(move);
 
-    moves->count = 0;
+    if (IsEnpass(move))
+        return epIsLegal(board, &info, from, to);
+
+    if (from == info.kingSq) {
+        // Castling can't start in, go through or end in check
+        if (IsCastling(move)) {
+            if (info.checkers)
+                return 0;
 
-    for (int i = 0; i < tempMoves.count; i++) {
-        if (makeMove(board, tempMoves.list[i]) == 0) {
-            undoMove(board, tempMoves.list[i]);
-            continue;
+            U64 path = squaresBetween(from, to) | (1ULL << to);
+            return !(path & info.unsafe);
         }
-        moves->list[i] = tempMoves.list[i];
-        moves->count++;
-        undoMove(board, tempMoves.list[i]);
+
+        return safeKingTargets(&info, 1ULL << to) != 0ULL;
     }
+
+    return testBit(legalTargets(&info, from), to);
 }
 
 void printMoveList(MoveList moves) {
@@ -17,9 +17,12 @@ typedef struct {
 #define CASTLE_MASK_BK 0x6000000000000000
 #define CASTLE_MASK_BQ 0xE00000000000000
 
-void generatePseudoLegalMoves(MoveList *moves, Board *board);
+// All generators only produce legal moves
 void generateLegalMoves(MoveList *moves, Board *board);
 void generateNoisyMoves(MoveList *moves, Board *board);
+void generateQuietMoves(MoveList *moves, Board *board);
+int isPseudoLegal(Board *board, Move move);
+int isLegal(Board *board, Move move);
 
 int moveExists(Board *board, Move move);
 
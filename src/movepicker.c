@@ -8,180 +8,247 @@
 #include "search.h"
 
 // Move ordering heuristics
+// Killers, history and counter moves live in each SearchThread
 int MvvLva[NB_PIECES][NB_PIECES];
 
-// Fail high history
-static Move killerMoves[MAX_SEARCH_DEPTH][2];
-static int quietHistory[MAX_SEARCH_DEPTH][64][64];
-static Move counterMoves[2][NB_PIECES][64]; // [side][from][to] (of last move)
-
-
-
 static int stat_bonus(int depth) {
     // A copy of the stat bonus formula from Ethereal but originally from Stockfish.
     return depth > 13 ? 32 : 16 * depth * depth + 128 * MAX(depth - 1, 0);
 }
 
-// Moves are scored on:
-    // All:
-        // SEE
-    // Quiets:
-        // Killer Heuristic
-        // History Heuristic
-        // Counter moves
-    // Captures:
-        // MVV-LVA
-static int scoreMove(Move move, Board *board, MovePicker *picker) {
-    // Quiet moves
-    if (!IsCapture(move)) {
-        if (move == picker->firstKiller)
-            return 2000000;
-        else if (move == picker->secondKiller)
-            return 1990000;
-        else if (move == picker->counterMove)
-            return 1980000;
-        
-        // Quiet moves which fail SEE are probably bad and, even worse than bad captures
-        // They become worse and worse the more material they hang e.g. a queen move failing SEE would score -505
-        if (!SEE(board, move, 0)) return -500 - board->squares[MoveFrom(move)];
-        return quietHistory[picker->ply][MoveFrom(move)][MoveTo(move)];
-    }
-    // Captures sorted by SEE then MVV-LVA
-    else {
-        if (SEE(board, move, 0))
-            // Good captures come before killers and after hash
-            // Sorted by MVV-LVA
-            return MvvLva[board->squares[MoveTo(move)]][board->squares[MoveFrom(move)]] + 5000000;
-        else
-            // Bad captures come after killers
-            return MvvLva[board->squares[MoveTo(move)]][board->squares[MoveFrom(move)]] - 10000;
-    }
+// Noisy moves are scored on:
+    // MVV-LVA
+    // SEE, which is only checked once the move gets to the top of the heap
+static int scoreNoisyMove(Move move, Board *board) {
+    // A quiet promotion counts as winning a queen
+    int score = !IsCapture(move) ? MvvLva[QUEEN][PAWN]
+              : IsEnpass(move)   ? MvvLva[PAWN][PAWN]
+              : MvvLva[board->squares[MoveTo(move)]][board->squares[MoveFrom(move)]];
+
+    // Underpromotions are almost never good, so they go last
+    if (IsPromotion(move) && MovePromotedPiece(move) != QUEEN)
+        return score - 64;
+
+    // Everything else starts off as a good capture until SEE says otherwise
+    return GOOD_NOISY_SCORE + score;
+}
+
+// Bad captures keep their MVV-LVA offset, so losing captures of a piece
+// still score above zero and get tried before the quiets
+static int badNoisyScore(int score) {
+    return score - GOOD_NOISY_SCORE - 8;
+}
+
+// Quiet moves are scored on:
+    // History Heuristic
+    // SEE, which is only checked once the move gets to the top of the heap
+// Killers and counter moves have their own stages
+static int scoreQuietMove(Move move, MovePicker *picker) {
+    return MIN(picker->thread->quietHistory[picker->ply][MoveFrom(move)][MoveTo(move)], MAX_HISTORY_SCORE);
+}
+
+// Quiet moves which fail SEE are probably bad
+// They become worse and worse the more material they hang e.g. a queen move failing SEE would score -505
+static int badQuietScore(Move move, Board *board) {
+    return -500 - board->squares[MoveFrom(move)];
+}
+
+static int isRefutation(Move move, MovePicker *picker) {
+    return move == picker->firstKiller || move == picker->secondKiller || move == picker->counterMove;
+}
+
+// Killers and counter moves come from other positions, so they're only
+// tried if they're a legal quiet here (and haven't been tried already)
+static int refutationIsUsable(MovePicker *picker, Board *board, Move move) {
+    return move != NO_MOVE
+        && move != picker->hashMove
+        && !IsCapture(move) && !IsPromotion(move)
+        && isPseudoLegal(board, move) && isLegal(board, move);
 }
 
 // Indexed this way:
 // MvvLva[victim][attacker];
+// Pawn victims score below 8, which badNoisyScore() relies on
 void initMvvLva() {
     for (int attacker = PAWN; attacker < NB_PIECES; attacker++) {
         for (int victim = PAWN; victim < NB_PIECES; victim++) {
-            MvvLva[victim][attacker] =
-                    (100 * middleGameMaterial[victim] - middleGameMaterial[attacker]);
+            MvvLva[victim][attacker] = 8 * victim + (KING - attacker);
         }
     }
 }
 
-int getQuietHistory(Move move, int ply) {
-    return quietHistory[ply][MoveFrom(move)][MoveTo(move)];
+int getQuietHistory(SearchThread *thread, Move move, int ply) {
+    return thread->quietHistory[ply][MoveFrom(move)][MoveTo(move)];
 }
 
-void updateCounterMoves(Board *board, Move move) {
+void updateCounterMoves(SearchThread *thread, Move move) {
+    Board *board = &thread->board;
+
     // Get the index which is determined by past board state
     int movedPiece = board->history[board->ply-1].movedPiece;
     int moveDestination = MoveTo(board->history[board->ply-1].move);
 
     // Update the counter
-    counterMoves[board->side][movedPiece][moveDestination] = move;
+    thread->counterMoves[board->side][movedPiece][moveDestination] = move;
 }
 
-void updateQuietHistory(Move move, int ply, int depth) {
+void updateQuietHistory(SearchThread *thread, Move move, int ply, int depth) {
     if (depth < 2) return;
 
-    int *histEntry = &quietHistory[ply][MoveFrom(move)][MoveTo(move)];
+    int *histEntry = &thread->quietHistory[ply][MoveFrom(move)][MoveTo(move)];
     *histEntry += depth * depth;
 }
 
-void updateKillerMoves(Move move, int ply) {
+void updateKillerMoves(SearchThread *thread, Move move, int ply) {
     // Don't add to killers if the move is already there
-    if (killerMoves[ply][0] != move) {
-        killerMoves[ply][1] = killerMoves[ply][0];
-        killerMoves[ply][0] = move;
+    if (thread->killerMoves[ply][0] != move) {
+        thread->killerMoves[ply][1] = thread->killerMoves[ply][0];
+        thread->killerMoves[ply][0] = move;
     }
 }
 
-void clearKillerMoves() {
+void clearKillerMoves(SearchThread *thread) {
     // Called before every search, since killers from the previous search
     // aren't going to be applicable since the ply number for
     // corresponding positions has changed
     for (int ply = 0; ply < MAX_SEARCH_DEPTH; ply++) {
-        killerMoves[ply][0] = NO_MOVE;
-        killerMoves[ply][1] = NO_MOVE;
+        thread->killerMoves[ply][0] = NO_MOVE;
+        thread->killerMoves[ply][1] = NO_MOVE;
     }
 }
 
-void clearHistoryHeuristics() {
+void clearHistoryHeuristics(SearchThread *thread) {
     for (int ply = 0; ply < MAX_SEARCH_DEPTH; ply++) {
         for (int from = 0; from < 64; from++) {
             for (int to = 0; to < 64; to++) {
-                quietHistory[ply][from][to] = 0;
+                thread->quietHistory[ply][from][to] = 0;
             }
         }
     }
 }
 
 // Checks if it's either the first killer at that ply or the second killer
-int isKillerMove(Move move, int ply) {
-    return (move == killerMoves[ply][0]) || (move == killerMoves[ply][1]);
+int isKillerMove(SearchThread *thread, Move move, int ply) {
+    return (move == thread->killerMoves[ply][0]) || (move == thread->killerMoves[ply][1]);
+}
+
+void initMoveRange(MoveRange *range, int start, int end) {
+    range->current = start;
+    range->end = end;
+    range->picks = 0;
+    range->sorted = 0;
 }
 
-// Scores all the moves in the list
-static void scoreMoveList(MoveList *moves, int *scores, Board *board, MovePicker *picker) {
-    for (int i = 0; i < moves->count; i++) {
-        scores[i] = scoreMove(moves->list[i], board, picker);
+// Sorts the entries best first
+static void insertionSort(ScoredMove *moves, int count) {
+    for (int i = 1; i < count; i++) {
+        ScoredMove entry = moves[i];
+        int j = i - 1;
+        while (j >= 0 && moves[j] < entry) {
+            moves[j + 1] = moves[j];
+            j--;
+        }
+        moves[j + 1] = entry;
     }
 }
 
-// Function to heapify a subtree with root at index i
-void heapify(int *moveScores, Move *moveList, int n, int i) {
-    int largest = i;  // Initialize largest as root
-    int left = 2 * i + 1;  // left child
-    int right = 2 * i + 2;  // right child
-
-    // If left child is larger than root
-    if (left < n && moveScores[left] > moveScores[largest])
-        largest = left;
-
-    // If right child is larger than largest so far
-    if (right < n && moveScores[right] > moveScores[largest])
-        largest = right;
-
-    // If largest is not root
-    if (largest != i) {
-        // Swap scores
-        int tempScore = moveScores[i];
-        moveScores[i] = moveScores[largest];
-        moveScores[largest] = tempScore;
-
-        // Swap moves
-        Move tempMove = moveList[i];
-        moveList[i] = moveList[largest];
-        moveList[largest] = tempMove;
-
-        // Recursively heapify the affected subtree
-        heapify(moveScores, moveList, n, largest);
+// Index of the best entry left in the range
+int bestInRange(ScoredMove *moves, MoveRange *range) {
+    if (range->sorted)
+        return range->current;
+
+    // We've gone past the few picks most nodes need, so we're likely going to
+    // try everything and sorting once is cheaper than selecting every time
+    if (range->picks >= SELECTION_PICKS) {
+        insertionSort(moves + range->current, range->end - range->current);
+        range->sorted = 1;
+        return range->current;
+    }
+
+    int best = range->current;
+    for (int i = range->current + 1; i < range->end; i++) {
+        if (moves[i] > moves[best])
+            best = i;
+    }
+    return best;
+}
+
+// Takes the entry at index out of the range
+ScoredMove takeFromRange(ScoredMove *moves, MoveRange *range, int index) {
+    ScoredMove entry = moves[index];
+
+    // The front entry fills the hole, which is a no-op once sorted
+    moves[index] = moves[range->current];
+    range->current++;
+    range->picks++;
+
+    return entry;
+}
+
+// Gives the entry at index a new (lower) score
+static void demoteInRange(ScoredMove *moves, MoveRange *range, int index, int score) {
+    ScoredMove entry = MakeScoredMove(ScoredMoveMove(moves[index]), score);
+
+    // Sink it down to keep a sorted range sorted
+    if (range->sorted) {
+        while (index + 1 < range->end && moves[index + 1] > entry) {
+            moves[index] = moves[index + 1];
+            index++;
+        }
     }
+    moves[index] = entry;
 }
 
-// Function to build a max-heap from the movelist
-void buildMaxHeap(int *moveScores, Move *moveList, int n) {
-    // Build heap (rearrange array)
-    for (int i = n / 2 - 1; i >= 0; i--) {
-        heapify(moveScores, moveList, n, i);
+// Generates and scores the noisy moves at the front of the list
+static void generateNoisy(MovePicker *picker, Board *board) {
+    MoveList noisy;
+    generateNoisyMoves(&noisy, board);
+
+    for (int i = 0; i < noisy.count; i++)
+        picker->moves[i] = MakeScoredMove(noisy.list[i], scoreNoisyMove(noisy.list[i], board));
+
+    initMoveRange(&picker->noisy, 0, noisy.count);
+}
+
+// Picks the best noisy move which is worth trying before the quiets
+// A move still in the good band hasn't been through SEE yet, so it's checked
+// now and demoted if it fails. That way only the moves we actually get to pay
+// for SEE
+static Move pickGoodNoisy(MovePicker *picker, Board *board, int *moveScore) {
+    while (picker->noisy.current < picker->noisy.end) {
+        int best = bestInRange(picker->moves, &picker->noisy);
+        Move move = ScoredMoveMove(picker->moves[best]);
+        int score = ScoredMoveScore(picker->moves[best]);
+
+        if (score < 0)
+            return NO_MOVE;
+
+        if (score >= GOOD_NOISY_SCORE && !SEE(board, move, 0)) {
+            demoteInRange(picker->moves, &picker->noisy, best, badNoisyScore(score));
+            continue;
+        }
+
+        takeFromRange(picker->moves, &picker->noisy, best);
+        *moveScore = score;
+        return move;
     }
+
+    return NO_MOVE;
 }
 
 // Initialises picker on hashMove if it exists, otherwise we start with
-// generation
-// TODO: Try noisy moves separately (this time without killing my sanity with
-// 100 segfaults)
-void initMovePicker(MovePicker *picker, Move hashMove, int ply, Board *board) {
+// generating the noisy moves
+void initMovePicker(MovePicker *picker, SearchThread *thread, Move hashMove, int ply) {
+    Board *board = &thread->board;
+    picker->thread = thread;
+
     // Assign hashMove
     picker->hashMove = hashMove;
-    picker->stage = hashMove == NO_MOVE ? STAGE_GENERATE : STAGE_HASH_MOVE;
-
-    picker->heapBuilt = 0;
+    picker->stage = hashMove == NO_MOVE ? STAGE_GENERATE_NOISY : STAGE_HASH_MOVE;
 
     // Assign killers
-    picker->firstKiller = killerMoves[ply][0];
-    picker->secondKiller = killerMoves[ply][1];
+    picker->firstKiller = thread->killerMoves[ply][0];
+    picker->secondKiller = thread->killerMoves[ply][1];
 
     // Assign counter move
     if (board->ply > 0) {
@@ -190,7 +257,7 @@ void initMovePicker(MovePicker *picker, Move hashMove, int ply, Board *board) {
 
         // There is no counter to a null move
         picker->counterMove = lastMove == NO_MOVE ? NO_MOVE
-            : counterMoves[!board->side][board->history[board->ply-1].movedPiece][MoveTo(lastMove)];
+            : thread->counterMoves[!board->side][board->history[board->ply-1].movedPiece][MoveTo(lastMove)];
     } else {
         // If this is the first move there is no counter move
         picker->counterMove = NO_MOVE;
@@ -200,14 +267,16 @@ void initMovePicker(MovePicker *picker, Move hashMove, int ply, Board *board) {
     picker->ply = ply;
 }
 
-void initNoisyPicker(MovePicker *picker) {
-    // Start with generation since there is no hash
-    picker->stage = STAGE_GENERATE;
+void initNoisyPicker(MovePicker *picker, SearchThread *thread) {
+    picker->thread = thread;
+
+    // Quiescence has its own stages which only ever see noisy moves
+    picker->stage = STAGE_QS_GENERATE;
 
     // No killers, hashMove or counterMove in quiescence
     picker->hashMove = NO_MOVE;
     picker->firstKiller = NO_MOVE;
-    picker->firstKiller = NO_MOVE;
+    picker->secondKiller = NO_MOVE;
     picker->counterMove = NO_MOVE;
 
     // Ply is not needed to score noisy moves
@@ -215,66 +284,151 @@ void initNoisyPicker(MovePicker *picker) {
 }
 
 Move pickMove(MovePicker *picker, Board *board, int *moveScore) {
+    Move move;
+    int best;
+
     switch (picker->stage) {
     // Return hash move first if there is one
     // If this causes a cutoff, we skip move generation
     // which saves us a little time
+    // The hash move might come from a different position (a collision or a
+    // stale entry), so it has to be checked against the board first
     case STAGE_HASH_MOVE:
-        picker->stage = STAGE_GENERATE;
-        return picker->hashMove;
+        picker->stage = STAGE_GENERATE_NOISY;
+        if (isPseudoLegal(board, picker->hashMove) && isLegal(board, picker->hashMove)) {
+            *moveScore = INT16_MAX;
+            return picker->hashMove;
+        }
 
-    // Generate the moves and score them
-    case STAGE_GENERATE:
-        generatePseudoLegalMoves(&picker->moveList, board);
-        scoreMoveList(&picker->moveList, picker->moveScores, board, picker);
+        // fall through
 
-        picker->stage = STAGE_MAIN;
+    // Generate and score only the captures and promotions
+    case STAGE_GENERATE_NOISY:
+        generateNoisy(picker, board);
+        picker->stage = STAGE_GOOD_NOISY;
 
-        // We fall through to the next stage after scoring and generation
+        // fall through
 
-case STAGE_MAIN:
-    SKIP_MOVE:
-        // Detect if we're already finished
-        if (picker->moveList.count == 0) {
-            picker->stage = STAGE_DONE;
-            return NO_MOVE;
+    // Noisy moves scoring above zero, once the best one left is below that
+    // we know only the bad ones are left
+    case STAGE_GOOD_NOISY:
+        while ((move = pickGoodNoisy(picker, board, moveScore)) != NO_MOVE) {
+            if (move != picker->hashMove)
+                return move;
+        }
+
+        picker->stage = STAGE_FIRST_KILLER;
+
+        // fall through
+
+    // Killers and the counter move are tried before the quiets are
+    // generated, when one of them cuts we never generate the quiets at all
+    case STAGE_FIRST_KILLER:
+        picker->stage = STAGE_SECOND_KILLER;
+        if (refutationIsUsable(picker, board, picker->firstKiller)) {
+            *moveScore = KILLER_SCORE;
+            return picker->firstKiller;
+        }
+
+        // fall through
+
+    case STAGE_SECOND_KILLER:
+        picker->stage = STAGE_COUNTER_MOVE;
+        if (   picker->secondKiller != picker->firstKiller
+            && refutationIsUsable(picker, board, picker->secondKiller)) {
+            *moveScore = KILLER_SCORE - 1;
+            return picker->secondKiller;
+        }
+
+        // fall through
+
+    case STAGE_COUNTER_MOVE:
+        picker->stage = STAGE_GENERATE_QUIET;
+        if (   picker->counterMove != picker->firstKiller
+            && picker->counterMove != picker->secondKiller
+            && refutationIsUsable(picker, board, picker->counterMove)) {
+            *moveScore = KILLER_SCORE - 2;
+            return picker->counterMove;
         }
 
-        // Build the max-heap for the first time
-        if (picker->heapBuilt == 0) {
-            buildMaxHeap(picker->moveScores, picker->moveList.list, picker->moveList.count);
-            picker->heapBuilt = 1; // Mark heap as built
+        // fall through
+
+    // Only now do we pay for generating and scoring the quiets
+    // They go after the noisy moves in the list, minus the ones already tried
+    case STAGE_GENERATE_QUIET: {
+        MoveList quiets;
+        generateQuietMoves(&quiets, board);
+
+        int end = picker->noisy.end;
+        for (int i = 0; i < quiets.count; i++) {
+            move = quiets.list[i];
+            if (move == picker->hashMove || isRefutation(move, picker))
+                continue;
+            picker->moves[end++] = MakeScoredMove(move, scoreQuietMove(move, picker));
         }
 
-        // Get the best move (the root of the heap, i.e., index 0)
-        Move bestMove = picker->moveList.list[0];
-        *moveScore = picker->moveScores[0];
+        initMoveRange(&picker->quiet, picker->noisy.end, end);
+        picker->stage = STAGE_QUIET;
+    }
 
-        // Replace the root with the last element
-        picker->moveList.list[0] = picker->moveList.list[picker->moveList.count - 1];
-        picker->moveScores[0] = picker->moveScores[picker->moveList.count - 1];
+        // fall through
 
-        // Pop the last element (decrease move list count)
-        picker->moveList.count--;
+    case STAGE_QUIET:
+        while (picker->quiet.current < picker->quiet.end) {
+            best = bestInRange(picker->moves, &picker->quiet);
+            move = ScoredMoveMove(picker->moves[best]);
+            *moveScore = ScoredMoveScore(picker->moves[best]);
 
-        // Re-heapify the reduced heap
-        heapify(picker->moveScores, picker->moveList.list, picker->moveList.count, 0);
+            // Same lazy SEE as the noisy moves, quiets which haven't been
+            // demoted yet are checked the first time they come up
+            if (*moveScore >= 0 && !SEE(board, move, 0)) {
+                demoteInRange(picker->moves, &picker->quiet, best, badQuietScore(move, board));
+                continue;
+            }
 
-        // Check if the move is the hash move, skip it if so
-        if (bestMove == picker->hashMove) {
-            goto SKIP_MOVE;
+            takeFromRange(picker->moves, &picker->quiet, best);
+            return move;
         }
 
-        // Return the best move
-        return bestMove;
+        picker->stage = STAGE_BAD_NOISY;
+
+        // fall through
+
+    // Pawn captures which failed SEE and underpromotions go last
+    case STAGE_BAD_NOISY:
+        while (picker->noisy.current < picker->noisy.end) {
+            ScoredMove entry = takeFromRange(picker->moves, &picker->noisy,
+                                             bestInRange(picker->moves, &picker->noisy));
+            move = ScoredMoveMove(entry);
+            if (move != picker->hashMove) {
+                *moveScore = ScoredMoveScore(entry);
+                return move;
+            }
+        }
 
-        // Fallback when we run out of moves
         picker->stage = STAGE_DONE;
-        return NO_MOVE;
+
+        // fall through
 
     case STAGE_DONE:
         return NO_MOVE;
 
+    // Quiescence only generates and scores captures and promotions
+    case STAGE_QS_GENERATE:
+        generateNoisy(picker, board);
+        picker->stage = STAGE_QS_NOISY;
+
+        // fall through
+
+    // The bad noisy moves are never worth it in quiescence, so we stop
+    // once only those are left
+    case STAGE_QS_NOISY:
+        if ((move = pickGoodNoisy(picker, board, moveScore)) != NO_MOVE)
+            return move;
+
+        picker->stage = STAGE_DONE;
+        return NO_MOVE;
+
     default:
         puts("Something went wrong in the movepicker");
         return NO_MOVE;
@@ -1,34 +1,94 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "board.h"
 #include "move.h"
 #include "movegen.h"
+#include "threads.h"
+
+// Moves are generated and tried in stages so that a cutoff from the hash move
+// or a good capture means we never generate or score the quiets
+enum {
+    STAGE_HASH_MOVE,
+    STAGE_GENERATE_NOISY,
+    STAGE_GOOD_NOISY,
+    STAGE_FIRST_KILLER,
+    STAGE_SECOND_KILLER,
+    STAGE_COUNTER_MOVE,
+    STAGE_GENERATE_QUIET,
+    STAGE_QUIET,
+    STAGE_BAD_NOISY,
+    STAGE_DONE,
+
+    // Quiescence
+    STAGE_QS_GENERATE,
+    STAGE_QS_NOISY
+};
+
+// A move and its score packed into 32 bits
+// The score sits in the high half so comparing two entries compares their scores
+typedef int32_t ScoredMove;
+
+#define MakeScoredMove(move, score) ((ScoredMove)(((uint32_t)(uint16_t)(score) << 16) | (move)))
+#define ScoredMoveMove(entry) ((Move)((entry) & 0xffff))
+#define ScoredMoveScore(entry) ((int16_t)((uint32_t)(entry) >> 16))
 
-enum { STAGE_HASH_MOVE, STAGE_GENERATE, STAGE_MAIN, STAGE_DONE };
+// Move scores have to fit in 16 bits
+// Noisy moves scoring at least GOOD_NOISY_SCORE passed SEE, the ones scoring
+// below zero are tried after the quiets
+#define GOOD_NOISY_SCORE 30000
+#define KILLER_SCORE 29000
+#define MAX_HISTORY_SCORE 27999
+
+// The SEE result of a picked move lives in its score, so search can reuse it
+// without calling SEE again (killers, the counter move and the hash move never
+// get checked and count as passing)
+#define FailedSEE(move, score) ((IsCapture(move) || IsPromotion(move)) ? (score) < GOOD_NOISY_SCORE : (score) < 0)
+
+// Moves left to pick are in [current, end)
+// The first few picks are done by selection, since most nodes which cut off do
+// so within them. After that the rest of the range is insertion sorted once
+// and taken in order
+#define SELECTION_PICKS 3
 
 typedef struct {
-    MoveList moveList;
-    int moveScores[MAX_LEGAL_MOVES];
+    int current;
+    int end;
+    int picks;
+    int sorted;
+} MoveRange;
+
+// The noisy moves are at the front of the list and the quiets go after them
+// once generated
+typedef struct {
+    SearchThread *thread;
+    ScoredMove moves[MAX_LEGAL_MOVES];
+    MoveRange noisy, quiet;
     Move hashMove, firstKiller, secondKiller, counterMove;
     int stage;
     int ply;
-    int heapBuilt;
 } MovePicker;
 
 #define HISTORY_DIVISOR 16384
 
 // Move ordering heuristics
-int getQuietHistory(Move move, int ply);
-void updateQuietHistory(Move move, int ply, int depth);
-void updateKillerMoves(Move move, int ply);
-void updateCounterMoves(Board *board, Move move);
-int isKillerMove(Move move, int ply);
+int getQuietHistory(SearchThread *thread, Move move, int ply);
+void updateQuietHistory(SearchThread *thread, Move move, int ply, int depth);
+void updateKillerMoves(SearchThread *thread, Move move, int ply);
+void updateCounterMoves(SearchThread *thread, Move move);
+int isKillerMove(SearchThread *thread, Move move, int ply);
 
-void clearKillerMoves();
-void clearHistoryHeuristics();
+void clearKillerMoves(SearchThread *thread);
+void clearHistoryHeuristics(SearchThread *thread);
 
 // Move picker
-void initMovePicker(MovePicker *picker, Move hashMove, int ply, Board *board);
-void initNoisyPicker(MovePicker *picker);
+void initMovePicker(MovePicker *picker, SearchThread *thread, Move hashMove, int ply);
+void initNoisyPicker(MovePicker *picker, SearchThread *thread);
 Move pickMove(MovePicker *picker, Board *board, int *moveScore);
+
+// Exposed for the picker benchmark
+void initMoveRange(MoveRange *range, int start, int end);
+int bestInRange(ScoredMove *moves, MoveRange *range);
+ScoredMove takeFromRange(ScoredMove *moves, MoveRange *range, int index);
 void initMvvLva();
@@ -0,0 +1,288 @@
+#include "nnue.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+bool useNNUE = false;
+
+// Network weights, see nnue.h for the layout
+static int16_t *featureWeights = NULL; // [NNUE_INPUTS][NNUE_HIDDEN]
+static int16_t featureBiases[NNUE_HIDDEN];
+static int16_t outputWeights[2 * NNUE_HIDDEN];
+static int32_t outputBias;
+
+// A piece being added or removed by a move
+typedef struct {
+    int piece;
+    int color;
+    int sq;
+} PieceDelta;
+
+// Bumped by every loadNetwork(), so accumulators from an older network
+// never pass as up to date
+static int networkGeneration = 0;
+
+bool networkLoaded() { return featureWeights != NULL; }
+
+static inline bool accumulatorValid(const Accumulator *acc, U64 hash) {
+    return acc->hash == hash && acc->network == networkGeneration;
+}
+
+int loadNetwork(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Could not open '%s'\n", path);
+        return 0;
+    }
+
+    // Check the network has the shape we were compiled for
+    NNUEFileHeader info;
+    if (fread(&info, sizeof(info), 1, file) != 1
+        || memcmp(info.magic, NNUE_FILE_MAGIC, sizeof(NNUE_FILE_MAGIC)) != 0
+        || info.version != NNUE_FILE_VERSION
+        || info.inputs != NNUE_INPUTS
+        || info.hidden != NNUE_HIDDEN) {
+        printf("'%s' is not a valid network file\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    int16_t *weights = malloc(sizeof(int16_t) * NNUE_INPUTS * NNUE_HIDDEN);
+    if (weights == NULL) {
+        puts("Network allocation failed.");
+        exit(1);
+    }
+
+    // Read everything before touching the current network, so a bad file
+    // leaves it as it was
+    int16_t biases[NNUE_HIDDEN];
+    int16_t outputs[2 * NNUE_HIDDEN];
+    int32_t bias;
+    if (fread(weights, sizeof(int16_t), (size_t)NNUE_INPUTS * NNUE_HIDDEN, file) != (size_t)NNUE_INPUTS * NNUE_HIDDEN
+        || fread(biases, sizeof(biases), 1, file) != 1
+        || fread(outputs, sizeof(outputs), 1, file) != 1
+        || fread(&bias, sizeof(bias), 1, file) != 1) {
+        printf("'%s' is truncated\n", path);
+        free(weights);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    free(featureWeights);
+    featureWeights = weights;
+    memcpy(featureBiases, biases, sizeof(biases));
+    memcpy(outputWeights, outputs, sizeof(outputs));
+    outputBias = bias;
+    networkGeneration++;
+
+    return 1;
+}
+
+// Input index of a piece as seen from perspective with its king on kingSq
+static inline int featureIndex(int perspective, int kingSq, int piece, int color, int sq) {
+    // Black sees the board upside down so both sides look like white
+    if (perspective == BLACK) {
+        kingSq = MIRROR_SQ(kingSq);
+        sq = MIRROR_SQ(sq);
+    }
+    int pieceIndex = piece + (color == perspective ? 0 : 5);
+    return kingSq * 640 + pieceIndex * 64 + sq;
+}
+
+// dst = src + the weight rows of adds - the weight rows of subs
+// Done a register's worth of neurons at a time so each neuron is only
+// loaded and stored once
+static void updateAccumulator(int16_t *dst, const int16_t *src,
+                              const int *adds, int addCount,
+                              const int *subs, int subCount) {
+#if defined(__AVX2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i values = _mm256_loadu_si256((const __m256i *)(src + i));
+        for (int j = 0; j < addCount; j++)
+            values = _mm256_add_epi16(values, _mm256_loadu_si256((const __m256i *)(featureWeights + adds[j] * NNUE_HIDDEN + i)));
+        for (int j = 0; j < subCount; j++)
+            values = _mm256_sub_epi16(values, _mm256_loadu_si256((const __m256i *)(featureWeights + subs[j] * NNUE_HIDDEN + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), values);
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i values = _mm_loadu_si128((const __m128i *)(src + i));
+        for (int j = 0; j < addCount; j++)
+            values = _mm_add_epi16(values, _mm_loadu_si128((const __m128i *)(featureWeights + adds[j] * NNUE_HIDDEN + i)));
+        for (int j = 0; j < subCount; j++)
+            values = _mm_sub_epi16(values, _mm_loadu_si128((const __m128i *)(featureWeights + subs[j] * NNUE_HIDDEN + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), values);
+    }
+#else
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int16_t value = src[i];
+        for (int j = 0; j < addCount; j++)
+            value += featureWeights[adds[j] * NNUE_HIDDEN + i];
+        for (int j = 0; j < subCount; j++)
+            value -= featureWeights[subs[j] * NNUE_HIDDEN + i];
+        dst[i] = value;
+    }
+#endif
+}
+
+// Sum of clip(values) * weights over one half of the hidden layer
+static inline int32_t clippedDot(const int16_t *values, const int16_t *weights) {
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i clipped = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((const __m256i *)(values + i)), zero), max);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(clipped, _mm256_loadu_si256((const __m256i *)(weights + i))));
+    }
+    __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4E));
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xB1));
+    return _mm_cvtsi128_si32(total);
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i clipped = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i *)(values + i)), zero), max);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(clipped, _mm_loadu_si128((const __m128i *)(weights + i))));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int32_t clipped = values[i] < 0 ? 0 : values[i] > NNUE_QA ? NNUE_QA : values[i];
+        sum += clipped * weights[i];
+    }
+    return sum;
+#endif
+}
+
+static inline Accumulator *currentAccumulator(Board *board) {
+    return &board->accumulators[board->ply & (ACCUMULATOR_SLOTS - 1)];
+}
+
+// Rebuilds one perspective of an accumulator from the pieces on the board
+static void refreshPerspective(Board *board, Accumulator *acc, int perspective) {
+    int features[32];
+    int count = 0;
+
+    int kingSq = getlsb(board->pieces[KING] & board->colors[perspective]);
+    U64 pieces = board->colors[BOTH] & ~board->pieces[KING];
+    while (pieces) {
+        int sq = poplsb(&pieces);
+        int color = testBit(board->colors[WHITE], sq) ? WHITE : BLACK;
+        features[count++] = featureIndex(perspective, kingSq, board->squares[sq], color, sq);
+    }
+
+    updateAccumulator(acc->values[perspective], featureBiases, features, count, NULL, 0);
+}
+
+void nnueRefresh(Board *board) {
+    Accumulator *acc = currentAccumulator(board);
+    refreshPerspective(board, acc, WHITE);
+    refreshPerspective(board, acc, BLACK);
+    acc->hash = board->hash;
+    acc->network = networkGeneration;
+}
+
+// Brings the accumulator up to date after makeMove() has played move
+// If the previous ply's accumulator is stale this one is left stale too,
+// and nnueEvaluate() refreshes it if it ever gets used
+void nnueMakeMove(Board *board, Move move) {
+    Accumulator *acc = currentAccumulator(board);
+    Accumulator *parent = &board->accumulators[(board->ply - 1) & (ACCUMULATOR_SLOTS - 1)];
+    Undo *undo = &board->history[board->ply - 1];
+
+    if (!accumulatorValid(parent, undo->hash))
+        return;
+
+    int us = !board->side;
+    int from = MoveFrom(move);
+    int to = MoveTo(move);
+    int movedPiece = undo->movedPiece;
+
+    PieceDelta added[2], removed[2];
+    int addCount = 0, removeCount = 0;
+
+    if (IsCastling(move)) {
+        // Kings aren't inputs, so only the rook moves
+        int rookFrom = (to > from) ? to + 1 : to - 2;
+        int rookTo = (to > from) ? to - 1 : to + 1;
+        removed[removeCount++] = (PieceDelta){ROOK, us, rookFrom};
+        added[addCount++] = (PieceDelta){ROOK, us, rookTo};
+    } else {
+        if (movedPiece != KING) {
+            removed[removeCount++] = (PieceDelta){movedPiece, us, from};
+            int newPiece = IsPromotion(move) ? MovePromotedPiece(move) : movedPiece;
+            added[addCount++] = (PieceDelta){newPiece, us, to};
+        }
+        if (IsCapture(move)) {
+            int capturedSq = IsEnpass(move) ? to ^ 8 : to;
+            removed[removeCount++] = (PieceDelta){undo->capturedPiece, !us, capturedSq};
+        }
+    }
+
+    for (int perspective = WHITE; perspective <= BLACK; perspective++) {
+        // Everything is relative to our king, so when it moves we start over
+        if (perspective == us && movedPiece == KING) {
+            refreshPerspective(board, acc, perspective);
+            continue;
+        }
+
+        int kingSq = getlsb(board->pieces[KING] & board->colors[perspective]);
+        assert(addCount <= 2 && removeCount <= 2);
+        int adds[2] = {0}, subs[2] = {0};
+        for (int i = 0; i < addCount; i++)
+            adds[i] = featureIndex(perspective, kingSq, added[i].piece, added[i].color, added[i].sq);
+        for (int i = 0; i < removeCount; i++)
+            subs[i] = featureIndex(perspective, kingSq, removed[i].piece, removed[i].color, removed[i].sq);
+
+        updateAccumulator(acc->values[perspective], parent->values[perspective], adds, addCount, subs, removeCount);
+    }
+    acc->hash = board->hash;
+    acc->network = networkGeneration;
+
+#ifndef NDEBUG
+    Accumulator fresh;
+    refreshPerspective(board, &fresh, WHITE);
+    refreshPerspective(board, &fresh, BLACK);
+    assert(memcmp(fresh.values, acc->values, sizeof(fresh.values)) == 0);
+#endif
+}
+
+// A null move doesn't move any pieces, so the accumulator carries over
+void nnueMakeNullMove(Board *board) {
+    Accumulator *acc = currentAccumulator(board);
+    Accumulator *parent = &board->accumulators[(board->ply - 1) & (ACCUMULATOR_SLOTS - 1)];
+
+    if (!accumulatorValid(parent, board->history[board->ply - 1].hash))
+        return;
+
+    memcpy(acc->values, parent->values, sizeof(acc->values));
+    acc->hash = board->hash;
+    acc->network = networkGeneration;
+}
+
+// Network evaluation from the side to move's perspective
+int nnueEvaluate(Board *board) {
+    Accumulator *acc = currentAccumulator(board);
+    if (!accumulatorValid(acc, board->hash))
+        nnueRefresh(board);
+
+    int32_t output = outputBias
+                   + clippedDot(acc->values[board->side], outputWeights)
+                   + clippedDot(acc->values[!board->side], outputWeights + NNUE_HIDDEN);
+
+    int64_t eval = (int64_t)output * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+    return eval > NNUE_MAX_EVAL ? NNUE_MAX_EVAL : eval < -NNUE_MAX_EVAL ? -NNUE_MAX_EVAL : eval;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "board.h"
+
+/*
+    NNUE (efficiently updatable neural network) evaluation
+
+    An optional replacement for the hand written evaluation, turned on with
+    'setoption name UseNNUE value true' once a network has been loaded with
+    'setoption name EvalFile value [path]'
+
+    Architecture: HalfKP -> 2 x NNUE_HIDDEN -> 1
+
+    Inputs are (our king square, piece, square) triples for every piece but
+    the kings, seen from each side's perspective. Black's perspective is
+    flipped vertically so both sides look like white. Piece indices are 0-4
+    for our pawn to queen and 5-9 for theirs, so
+
+        feature = kingSq * 640 + piece * 64 + sq        (40960 inputs)
+
+    The first layer is the accumulator, kept per ply in the board and
+    updated by makeMove(). The side to move's half goes first, both halves
+    are clipped to [0, NNUE_QA] and fed into a single output neuron:
+
+        eval = (outputBias + sum(clip(acc) * outputWeights)) * NNUE_SCALE
+               / (NNUE_QA * NNUE_QB)
+
+    Network file layout, all little endian
+
+    [0, 32)        NNUEFileHeader
+    int16_t        featureWeights[NNUE_INPUTS][NNUE_HIDDEN]
+    int16_t        featureBiases[NNUE_HIDDEN]
+    int16_t        outputWeights[2 * NNUE_HIDDEN]
+    int32_t        outputBias
+
+    Feature weights and biases are quantised by NNUE_QA and output weights
+    by NNUE_QB, the output bias by both.
+*/
+#define NNUE_FILE_MAGIC "SAINTNN"
+#define NNUE_FILE_VERSION 1
+
+#define NNUE_INPUTS (64 * 10 * 64)
+#define NNUE_QA 255
+#define NNUE_QB 64
+#define NNUE_SCALE 400
+
+// Network evals are clamped to this, well clear of the mate scores and
+// EVAL_NONE in the hash table's 16 bit eval
+#define NNUE_MAX_EVAL 20000
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t inputs;
+    uint32_t hidden;
+    uint32_t padding[3];
+} NNUEFileHeader;
+
+// Set by the UCI option, only has an effect once a network is loaded
+extern bool useNNUE;
+
+int loadNetwork(const char *path);
+bool networkLoaded();
+
+void nnueRefresh(Board *board);
+void nnueMakeMove(Board *board, Move move);
+void nnueMakeNullMove(Board *board);
+int nnueEvaluate(Board *board);
@@ -0,0 +1,443 @@
+#include "packed.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "bitboards.h"
+#include "board.h"
+#include "zobrist.h"
+
+_Static_assert(sizeof(PackedPosition) == 32, "Packed positions must be 32 bytes");
+_Static_assert(sizeof(PackedFileHeader) == 32, "Packed file header must be 32 bytes");
+
+void packPosition(Board *board, int result, int score, PackedPosition *packed) {
+    memset(packed, 0, sizeof(PackedPosition));
+    packed->occupied = board->colors[BOTH];
+
+    // Kings can't be captured, so there are never more than 32 pieces
+    U64 occupied = board->colors[BOTH];
+    int index = 0;
+    while (occupied) {
+        int sq = poplsb(&occupied);
+        int color = testBit(board->colors[WHITE], sq) ? WHITE : BLACK;
+        packed->pieces[index / 2] |= (board->squares[sq] | color << 3) << (4 * (index % 2));
+        index++;
+    }
+
+    packed->flags = board->side | board->castlePerm << 1;
+    packed->epSquare = board->epSquare;
+    packed->fiftyMove = MIN(board->fiftyMove, 255);
+    packed->result = result;
+    packed->score = score;
+    packed->fullMove = MIN(fullMoveNumber(board), UINT16_MAX);
+}
+
+// Records come straight off disk, so check everything used as an index
+// before it gets near the board
+static bool validPackedPosition(const PackedPosition *packed) {
+    if (popCount(packed->occupied) > 32 || packed->result > 2)
+        return false;
+    if (packed->epSquare != NO_SQ && packed->epSquare >= 64)
+        return false;
+
+    // Exactly one king a side and nothing but real pieces
+    int kings[2] = {0, 0};
+    for (int index = 0; index < popCount(packed->occupied); index++) {
+        int nibble = (packed->pieces[index / 2] >> (4 * (index % 2))) & 15;
+        if ((nibble & 7) > KING)
+            return false;
+        if ((nibble & 7) == KING)
+            kings[nibble >> 3]++;
+    }
+    return kings[WHITE] == 1 && kings[BLACK] == 1;
+}
+
+// Sets up board from a packed position, like parseFen() does from a FEN
+// Returns 0 and leaves the board alone if the record is corrupt
+int unpackPosition(const PackedPosition *packed, Board *board) {
+    if (!validPackedPosition(packed))
+        return 0;
+
+    clearBoard(board);
+
+    U64 occupied = packed->occupied;
+    int index = 0;
+    while (occupied) {
+        int sq = poplsb(&occupied);
+        int nibble = (packed->pieces[index / 2] >> (4 * (index % 2))) & 15;
+        setPiece(board, nibble >> 3, nibble & 7, sq);
+        index++;
+    }
+
+    board->side = packed->flags & 1;
+    board->castlePerm = (packed->flags >> 1) & 15;
+    board->epSquare = packed->epSquare;
+    board->fiftyMove = packed->fiftyMove;
+    board->fullMoves = MAX(1, packed->fullMove);
+
+    board->hash = generateHash(board);
+    board->pawnHash = generatePawnHash(board);
+    return 1;
+}
+
+// Reads a result written as [1.0], 1.0, 1-0 or 1/2-1/2 (as in EPD c9 opcodes)
+// Returns it as a packed result, -1 if there isn't one
+static int parseResult(const char *text) {
+    if (strstr(text, "1/2-1/2"))
+        return 1;
+    if (strstr(text, "1-0"))
+        return 2;
+    if (strstr(text, "0-1"))
+        return 0;
+
+    // Last number on the line
+    const char *last = NULL;
+    for (const char *p = text; *p; p++)
+        if ((isdigit((unsigned char)*p) || *p == '.') && (p == text || (!isdigit((unsigned char)p[-1]) && p[-1] != '.')))
+            last = p;
+    if (last == NULL)
+        return -1;
+
+    double result = strtod(last, NULL);
+    return result > 0.75 ? 2 : result > 0.25 ? 1 : 0;
+}
+
+// Packs a line of tuning data, a FEN or EPD followed by the result
+// board is used as scratch space
+// Returns 0 if the line doesn't hold a position and a result
+int packedFromText(Board *board, char *line, PackedPosition *packed) {
+    char fen[128];
+    char *fields[6];
+    int count = 0;
+
+    // Board, side, castling and en passant, then optional move counters
+    char *p = line;
+    while (count < 6) {
+        while (*p == ' ')
+            p++;
+        if (*p == '\0' || *p == '\n' || *p == '\r')
+            break;
+
+        char *start = p;
+        while (*p && *p != ' ' && *p != '\n' && *p != '\r')
+            p++;
+
+        // Counters are plain numbers, anything else is the result or an opcode
+        if (count >= 4 && (size_t)(p - start) != strspn(start, "0123456789")) {
+            p = start;
+            break;
+        }
+
+        fields[count++] = start;
+        if (*p == '\0')
+            break;
+        *p++ = '\0';
+    }
+    if (count < 4)
+        return 0;
+
+    int result = parseResult(p);
+    if (result < 0)
+        return 0;
+
+    snprintf(fen, sizeof(fen), "%s %s %s %s %s %s", fields[0], fields[1], fields[2], fields[3],
+             count > 4 ? fields[4] : "0", count > 5 ? fields[5] : "1");
+    parseFen(board, fen);
+
+    packPosition(board, result, PACKED_NO_SCORE, packed);
+    return 1;
+}
+
+// Writes a packed position as 'FEN [result]', or as an EPD with a c9
+// opcode holding the result. line needs room for 128 characters
+// Returns 0 if the record is corrupt
+int packedToText(Board *board, const PackedPosition *packed, char *line, bool epd) {
+    if (!unpackPosition(packed, board))
+        return 0;
+    boardToFen(board, line);
+
+    if (epd) {
+        const char *results[3] = {"0-1", "1/2-1/2", "1-0"};
+
+        // EPDs have no move counters
+        char *end = line;
+        for (int spaces = 0; spaces < 4; end++)
+            if (*end == ' ')
+                spaces++;
+        sprintf(end - 1, " c9 \"%s\";", results[packed->result]);
+    } else {
+        sprintf(line + strlen(line), " [%.1f]", packed->result / 2.0);
+    }
+    return 1;
+}
+
+// Maps a packed file in for reading, see packed.h for the layout
+int openPackedFile(PackedFile *file, const char *path) {
+    memset(file, 0, sizeof(PackedFile));
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        printf("Could not open '%s'\n", path);
+        return 0;
+    }
+
+    PackedFileHeader info;
+    if (fread(&info, sizeof(info), 1, f) != 1
+        || memcmp(info.magic, PACKED_FILE_MAGIC, sizeof(PACKED_FILE_MAGIC)) != 0
+        || info.version != PACKED_FILE_VERSION
+        || info.recordSize != sizeof(PackedPosition)) {
+        printf("'%s' is not a valid packed file\n", path);
+        fclose(f);
+        return 0;
+    }
+
+    // Shuffled orders are kept as 32 bit indices
+    if (info.count > UINT32_MAX) {
+        printf("'%s' has too many positions\n", path);
+        fclose(f);
+        return 0;
+    }
+
+    uint64_t fileSize = sizeof(PackedFileHeader) + info.count * sizeof(PackedPosition);
+    fseek(f, 0, SEEK_END);
+    if ((uint64_t)ftell(f) < fileSize) {
+        printf("'%s' is truncated\n", path);
+        fclose(f);
+        return 0;
+    }
+
+    if (info.count == 0) {
+        fclose(f);
+        return 1;
+    }
+
+#ifdef __linux__
+    char *mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    fclose(f);
+    if (mapping == MAP_FAILED) {
+        printf("Could not map '%s'\n", path);
+        return 0;
+    }
+
+    file->memory = mapping;
+    file->memorySize = fileSize;
+    file->mapped = true;
+    file->positions = (const PackedPosition *)(mapping + sizeof(PackedFileHeader));
+#else
+    PackedPosition *positions = malloc(info.count * sizeof(PackedPosition));
+    if (positions == NULL) {
+        puts("Packed file allocation failed.");
+        fclose(f);
+        return 0;
+    }
+
+    fseek(f, sizeof(PackedFileHeader), SEEK_SET);
+    if (fread(positions, sizeof(PackedPosition), info.count, f) != info.count) {
+        printf("Failed to read '%s'\n", path);
+        free(positions);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    file->memory = positions;
+    file->memorySize = info.count * sizeof(PackedPosition);
+    file->positions = positions;
+#endif
+
+    file->count = info.count;
+    return 1;
+}
+
+void closePackedFile(PackedFile *file) {
+#ifdef __linux__
+    if (file->mapped)
+        munmap(file->memory, file->memorySize);
+#endif
+    if (!file->mapped)
+        free(file->memory);
+    free(file->order);
+    memset(file, 0, sizeof(PackedFile));
+}
+
+// Visits the positions in a random order from now on, starting over
+// The records stay where they are, only the order of indices is shuffled
+void shufflePackedFile(PackedFile *file, uint64_t seed) {
+    if (file->order == NULL) {
+        file->order = malloc(file->count * sizeof(uint32_t));
+        if (file->order == NULL && file->count > 0) {
+            puts("Packed file allocation failed.");
+            exit(1);
+        }
+        for (uint64_t i = 0; i < file->count; i++)
+            file->order[i] = i;
+    }
+
+    // Fisher-Yates with xorshift, see randomU64()
+    seed |= 1;
+    for (uint64_t i = file->count; i > 1; i--) {
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        uint64_t j = ((unsigned __int128)(seed * 0x2545F4914F6CDD1DULL) * i) >> 64;
+
+        uint32_t temp = file->order[i - 1];
+        file->order[i - 1] = file->order[j];
+        file->order[j] = temp;
+    }
+    file->next = 0;
+
+#ifdef __linux__
+    // Jumping around the file, so don't bother reading ahead
+    if (file->mapped)
+        madvise(file->memory, file->memorySize, MADV_RANDOM);
+#endif
+}
+
+// Next position in file order, or shuffled order after shufflePackedFile()
+// Returns NULL once every position has been visited
+const PackedPosition *nextPackedPosition(PackedFile *file) {
+    if (file->next >= file->count)
+        return NULL;
+
+    uint64_t index = file->order ? file->order[file->next] : file->next;
+    file->next++;
+    return &file->positions[index];
+}
+
+static int writePackedHeader(PackedWriter *writer) {
+    PackedFileHeader info = {0};
+    memcpy(info.magic, PACKED_FILE_MAGIC, sizeof(PACKED_FILE_MAGIC));
+    info.version = PACKED_FILE_VERSION;
+    info.recordSize = sizeof(PackedPosition);
+    info.count = writer->count;
+
+    return fseek(writer->file, 0, SEEK_SET) == 0
+        && fwrite(&info, sizeof(info), 1, writer->file) == 1;
+}
+
+int openPackedWriter(PackedWriter *writer, const char *path) {
+    writer->count = 0;
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        printf("Could not open '%s' for writing\n", path);
+        return 0;
+    }
+
+    // Written again with the real count when the writer is closed
+    return writePackedHeader(writer);
+}
+
+int writePackedPosition(PackedWriter *writer, const PackedPosition *packed) {
+    if (fwrite(packed, sizeof(PackedPosition), 1, writer->file) != 1)
+        return 0;
+    writer->count++;
+    return 1;
+}
+
+int writePackedPositions(PackedWriter *writer, const PackedPosition *packed, int count) {
+    if (fwrite(packed, sizeof(PackedPosition), count, writer->file) != (size_t)count)
+        return 0;
+    writer->count += count;
+    return 1;
+}
+
+int closePackedWriter(PackedWriter *writer) {
+    int success = writePackedHeader(writer);
+    success = (fclose(writer->file) == 0) && success;
+    writer->file = NULL;
+    return success;
+}
+
+// Packs a text file of 'FEN [result]' lines or EPDs with results
+int convertTextToPacked(const char *textPath, const char *packedPath) {
+    FILE *text = fopen(textPath, "r");
+    if (text == NULL) {
+        printf("Could not open '%s'\n", textPath);
+        return 0;
+    }
+
+    PackedWriter writer;
+    if (!openPackedWriter(&writer, packedPath)) {
+        fclose(text);
+        return 0;
+    }
+
+    // Boards are too big for the stack
+    Board *board = malloc(sizeof(Board));
+    if (board == NULL) {
+        puts("Board allocation failed.");
+        exit(1);
+    }
+
+    char line[512];
+    PackedPosition packed;
+    uint64_t skipped = 0;
+    int success = 1;
+    while (success && fgets(line, sizeof(line), text)) {
+        if (packedFromText(board, line, &packed))
+            success = writePackedPosition(&writer, &packed);
+        else
+            skipped++;
+    }
+
+    success = closePackedWriter(&writer) && success;
+    fclose(text);
+    free(board);
+
+    if (!success) {
+        printf("Failed to write '%s'\n", packedPath);
+        return 0;
+    }
+    printf("Packed %lu positions into '%s'", writer.count, packedPath);
+    printf(skipped ? ", skipped %lu lines\n" : "\n", skipped);
+    return 1;
+}
+
+// Unpacks a packed file to 'FEN [result]' lines, or EPDs if the path ends in .epd
+int convertPackedToText(const char *packedPath, const char *textPath) {
+    PackedFile file;
+    if (!openPackedFile(&file, packedPath))
+        return 0;
+
+    FILE *text = fopen(textPath, "w");
+    if (text == NULL) {
+        printf("Could not open '%s' for writing\n", textPath);
+        closePackedFile(&file);
+        return 0;
+    }
+
+    Board *board = malloc(sizeof(Board));
+    if (board == NULL) {
+        puts("Board allocation failed.");
+        exit(1);
+    }
+
+    size_t length = strlen(textPath);
+    bool epd = length >= 4 && strcmp(textPath + length - 4, ".epd") == 0;
+
+    char line[128];
+    const PackedPosition *packed;
+    uint64_t skipped = 0;
+    while ((packed = nextPackedPosition(&file)) != NULL) {
+        if (packedToText(board, packed, line, epd)) {
+            fprintf(text, "%s\n", line);
+        } else {
+            printf("Skipping corrupt record %lu\n", (uint64_t)(packed - file.positions));
+            skipped++;
+        }
+    }
+
+    int success = fclose(text) == 0;
+    printf("Unpacked %lu positions into '%s'", file.count - skipped, textPath);
+    printf(skipped ? ", skipped %lu corrupt records\n" : "\n", skipped);
+    closePackedFile(&file);
+    free(board);
+    return success;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "board.h"
+
+/*
+    Packed training positions
+
+    Fixed size 32 byte records for tuning and training data, so big data
+    sets can be mapped straight from disk instead of parsed from text.
+
+    occupied       Every occupied square
+    pieces         A nibble per occupied square, from a1 up in bit order,
+                   low nibble first. piece | color << 3
+    flags          Side to move in bit 0, castle permissions in bits 1-4
+    epSquare       En passant square, NO_SQ if none
+    fiftyMove      50 move rule counter
+    result         Game result from white's point of view, 0 = loss,
+                   1 = draw, 2 = win
+    score          Search score from white's point of view, PACKED_NO_SCORE
+                   if there isn't one
+    fullMove       Full move number, 0 if unknown
+
+    Packed file layout, all little endian
+
+    [0, 32)        PackedFileHeader
+    [32, ...)      The records
+*/
+#define PACKED_FILE_MAGIC "SAINTPK"
+#define PACKED_FILE_VERSION 1
+
+#define PACKED_NO_SCORE INT16_MIN
+
+typedef struct {
+    uint64_t occupied;
+    uint8_t pieces[16];
+    uint8_t flags;
+    uint8_t epSquare;
+    uint8_t fiftyMove;
+    uint8_t result;
+    int16_t score;
+    uint16_t fullMove;
+} PackedPosition;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t count;
+    uint64_t reserved;
+} PackedFileHeader;
+
+// Read only view of a packed file, mapped in on Linux
+typedef struct {
+    const PackedPosition *positions;
+    uint64_t count;
+
+    // Visiting order, see shufflePackedFile()
+    uint32_t *order;
+    uint64_t next;
+
+    void *memory;
+    uint64_t memorySize;
+    bool mapped;
+} PackedFile;
+
+// Appends records to a packed file, the header count is written on close
+typedef struct {
+    FILE *file;
+    uint64_t count;
+} PackedWriter;
+
+void packPosition(Board *board, int result, int score, PackedPosition *packed);
+int unpackPosition(const PackedPosition *packed, Board *board);
+
+int packedFromText(Board *board, char *line, PackedPosition *packed);
+int packedToText(Board *board, const PackedPosition *packed, char *line, bool epd);
+
+int openPackedFile(PackedFile *file, const char *path);
+void closePackedFile(PackedFile *file);
+void shufflePackedFile(PackedFile *file, uint64_t seed);
+const PackedPosition *nextPackedPosition(PackedFile *file);
+
+int openPackedWriter(PackedWriter *writer, const char *path);
+int writePackedPosition(PackedWriter *writer, const PackedPosition *packed);
+int writePackedPositions(PackedWriter *writer, const PackedPosition *packed, int count);
+int closePackedWriter(PackedWriter *writer);
+
+int convertTextToPacked(const char *textPath, const char *packedPath);
+int convertPackedToText(const char *packedPath, const char *textPath);
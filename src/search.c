@@ -14,6 +14,7 @@
 #include "move.h"
 #include "movegen.h"
 #include "movepicker.h"
+#include "threads.h"
 #include "timeman.h"
 
 // Global variables :skull:
@@ -88,22 +89,28 @@ static int isRepetition(Board *board) {
     return 0;
 }
 
+// Static evaluation through the thread's evaluation caches
+static inline int staticEvaluation(SearchThread *thread) {
+    return cachedEvaluate(&thread->board, &thread->evalCache, &thread->pawnTable);
+}
+
 int moveBestCaseScore(Move move, Board *board) {
     if (board->squares[MoveTo(move)] != EMPTY)
-        return middleGameMaterial[board->squares[MoveTo(move)]];
+        return ScoreMG(PieceValues[board->squares[MoveTo(move)]]);
     else
         return 0;
 }
 
-static int quiesce(Board *board, int alpha, int beta) {
-    searchInfo.nodes++;
+static int quiesce(SearchThread *thread, int alpha, int beta) {
+    Board *board = &thread->board;
+    thread->nodes++;
 
     /*
     During quiescence, we actually have the choice not to play a move at all when
     considering moves. This "stand pat" score is considered first here if it
     causes a cutoff
     */
-    int evaluation = evaluate(board);
+    int evaluation = staticEvaluation(thread);
     if (evaluation >= beta)
         return beta;
 
@@ -111,14 +118,14 @@ static int quiesce(Board *board, int alpha, int beta) {
     // In nodes that are so bad that even if we win a FULL queen and still don't
     // improve alpha, we might as well just not search it. It's highly unlikely
     // anything here was good anyways.
-    const int largeMaterialSwing = middleGameMaterial[QUEEN];
+    const int largeMaterialSwing = ScoreMG(PieceValues[QUEEN]);
     if (evaluation + largeMaterialSwing < alpha)
         return evaluation;
 
     alpha = MAX(evaluation, alpha);
 
     // The search has stopped, we must leave
-    if (searchInfo.stopped == true)
+    if (thread->info->stopped == true)
         return 0;
 
     // Start searching
@@ -128,17 +135,12 @@ static int quiesce(Board *board, int alpha, int beta) {
     int moveScore;
 
     MovePicker picker;
-    initNoisyPicker(&picker);
+    initNoisyPicker(&picker, thread);
 
     Move move;
+    // The picker only gives us captures and promotions which are worth trying
     while ((move = pickMove(&picker, board, &moveScore)) != NO_MOVE) {
 
-        // After a non-capture, there are no more noisy moves to check due to move sorting so we can break.
-        // If the move score is less than zero, that signifies the rest of the moves failed SEE so we can
-        // safely break then too.
-        if (!IsCapture(move) || moveScore < 0)
-            break;
-
         // Delta pruning
         // If a move is so bad that even if the value of the piece captured and
         // relatively large margin is not enough to raise alpha, we can prune it
@@ -146,14 +148,10 @@ static int quiesce(Board *board, int alpha, int beta) {
             continue;
 
 
-        // Skip illegals
-        if (makeMove(board, move) == 0) {
-            undoMove(board, move);
-            continue;
-        }
+        makeMove(board, move);
 
         // Next iteration
-        score = -quiesce(board, -beta, -alpha);
+        score = -quiesce(thread, -beta, -alpha);
         undoMove(board, move);
 
         if (score > bestScore) {
@@ -175,7 +173,9 @@ static int quiesce(Board *board, int alpha, int beta) {
 }
 
 // Principal variation search
-static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply, int pvNode, int doNull) {
+static int search(SearchThread *thread, int alpha, int beta, int depth, PV *pv, int ply, int pvNode, int doNull) {
+    Board *board = &thread->board;
+
     // This is a PV node if we're not doing a Null Window search
     // int pvNode = (beta - alpha > 1);
 
@@ -186,16 +186,16 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
     childPV.count = 0;
 
     // Check extension before quiescence
-    int inCheck = isSquareAttacked(
-            board, board->side,
-            getlsb(board->pieces[KING] & board->colors[board->side]));
+    // Only the king square is looked at here, the full attack info isn't
+    // worth building for nodes which get cut off by the hash table
+    int inCheck = attackersToKingSquare(board) != 0ULL;
     if (inCheck)
         depth++;
 
     // Drop to quiescence when depth runs out
     if (depth <= 0) {
         childPV.count = 0;
-        return quiesce(board, alpha, beta);
+        return quiesce(thread, alpha, beta);
     }
 
     /*
@@ -210,27 +210,28 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
     */
     Move hashMove = NO_MOVE;
     int hashDepth, hashScore, hashFlag;
+    int hashEval = EVAL_NONE;
     // 1. Root node
     if (!rootNode) {
-        searchInfo.hashAttempt++;
-        if (hashTableProbe(board->hash, &hashMove, &hashDepth, &hashScore, &hashFlag) == PROBE_SUCCESS) {
+        thread->hashAttempt++;
+        if (hashTableProbe(thread->hashTable, board->hash, &hashMove, &hashDepth, &hashScore, &hashEval, &hashFlag) == PROBE_SUCCESS) {
             // 2 + 3. Not PV node and enough depth
             if (!pvNode && hashDepth >= depth) {
                 // 4. Exact or produces a cutoff
                 if (hashFlag == BOUND_EXACT ||
                         (hashFlag == BOUND_LOWER && hashScore >= beta) ||
                         (hashFlag == BOUND_UPPER && hashScore <= alpha)) {
-                    searchInfo.hashHit++;
+                    thread->hashHit++;
                     return hashScore;
                 }
             }
         }
     }
 
-    searchInfo.nodes++;
+    thread->nodes++;
 
     // The search has stopped, we must leave
-    if (searchInfo.stopped == true)
+    if (thread->info->stopped == true)
         return 0;
 
     if (!rootNode) {
@@ -240,7 +241,7 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
         }
 
         if (ply >= MAX_SEARCH_DEPTH - 1)
-            return evaluate(board);
+            return staticEvaluation(thread);
 
         // Mate distance pruning
         alpha = MAX(alpha, -MATE + ply);
@@ -250,20 +251,34 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
         }
     }
 
-    if ((searchInfo.nodes & 4095) == 0) {
+    // Only the main thread keeps track of time and input
+    if (thread->index == 0 && !thread->info->silent && (thread->nodes & 4095) == 0) {
         checkTimeUp();
     }
 
+    // Fixed node searches stop themselves once all threads together reach
+    // the limit. Helpers only exist under beginSearch(), and adding up their
+    // counts is too slow to do every node
+    if (thread->index == 0 && thread->info->nodeLimit) {
+        bool helpers = thread->info == &searchInfo && threadCount > 1;
+        if (!helpers || (thread->nodes & 255) == 0) {
+            long nodes = helpers ? totalNodes() : thread->nodes;
+            if (nodes >= thread->info->nodeLimit)
+                thread->info->stopped = true;
+        }
+    }
+
     // Evaluation used for pruning later
-    int eval = evaluate(board);
+    // Reuse the static eval from the hash table when we have one
+    int eval = (hashEval != EVAL_NONE) ? hashEval : staticEvaluation(thread);
 
     // Internal iterative deepening
     // If we don't have a hash move in a PV node, we do a tiny search and then
     // probe the hash table again to greatly improve our move ordering for this node
     // Speeds up search in programs with bad move ordering (like this one)
     if (pvNode && depth >= 8 && hashMove == NO_MOVE) {
-        -search(board, alpha, beta, depth - 7, &childPV, ply + 1, IS_PV, doNull);
-        hashTableProbe(board->hash, &hashMove, &hashDepth, &hashScore, &hashFlag);
+        -search(thread, alpha, beta, depth - 7, &childPV, ply + 1, IS_PV, doNull);
+        hashTableProbe(thread->hashTable, board->hash, &hashMove, &hashDepth, &hashScore, &hashEval, &hashFlag);
     }
 
     // Adaptive null move pruning
@@ -273,7 +288,7 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
         int reduction = 4;
 
         makeNullMove(board);
-        int score = -search(board, -alpha - 1, -alpha, depth - reduction, &childPV, ply + 1, NOT_PV, false);
+        int score = -search(thread, -alpha - 1, -alpha, depth - reduction, &childPV, ply + 1, NOT_PV, false);
         undoNullMove(board);
 
         if (score >= beta)
@@ -296,7 +311,7 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
 
     // Start going through the moves in the position
     MovePicker picker;
-    initMovePicker(&picker, hashMove, ply, board);
+    initMovePicker(&picker, thread, hashMove, ply);
 
     Move move;
     while ((move = pickMove(&picker, board, &moveScore)) != NO_MOVE) {
@@ -311,12 +326,8 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
         //     && !SEE(board, move, -150 * depth))
         //     continue;
 
-        // Check move legality
-        if (makeMove(board, move) == 0) {
-            undoMove(board, move);
-            continue;
-        }
-        // Update count of legal moves played
+        // Every move the picker gives us is legal
+        makeMove(board, move);
         movesPlayed++;
 
             
@@ -339,7 +350,7 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
         // In a PV node, this full window will actually be full
         if (movesPlayed == 1 && pvNode) {
             // Inherits the node type
-            score = -search(board, -beta, -alpha, depth - 1, &childPV, ply + 1, pvNode, doNull);
+            score = -search(thread, -beta, -alpha, depth - 1, &childPV, ply + 1, pvNode, doNull);
         }
         // Prune the frick out of the rest of the moves because they're probably not
         // good
@@ -357,32 +368,34 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
             fail high, we must do a full depth null window search.
             */
             int reduction = 0;
-            if (!inCheck && depth > 2 && moveIsQuiet && !isKillerMove(move, ply)) {
+            if (!inCheck && depth > 2 && moveIsQuiet && !isKillerMove(thread, move, ply)) {
                 reduction = LMRDepths[depth][movesPlayed];
 
-
+                // Quiets which hang material get reduced a little more
+                if (FailedSEE(move, moveScore))
+                    reduction++;
 
                 if (reduction < 0) reduction = 0;
             }
 
 
             // Null window search with late move reduction depth
-            score = -search(board, -alpha - 1, -alpha, depth - 1 - reduction, &childPV, ply + 1, NOT_PV, doNull);
+            score = -search(thread, -alpha - 1, -alpha, depth - 1 - reduction, &childPV, ply + 1, NOT_PV, doNull);
             // Failed high so null window search with full depth
             if (reduction > 0 && score > alpha)
-                score = -search(board, -alpha - 1, -alpha, depth - 1, &childPV, ply + 1, NOT_PV, doNull);
+                score = -search(thread, -alpha - 1, -alpha, depth - 1, &childPV, ply + 1, NOT_PV, doNull);
 
             // Failed high, must be new pv
             // Re-search with full window
             if (score > alpha && score < beta)
-                score = -search(board, -beta, -alpha, depth - 1, &childPV, ply + 1, IS_PV, doNull);
+                score = -search(thread, -beta, -alpha, depth - 1, &childPV, ply + 1, IS_PV, doNull);
         }
 
         // Undo the move
         undoMove(board, move);
 
         // The search has stopped, we must leave
-        if (searchInfo.stopped == true)
+        if (thread->info->stopped == true)
             return 0;
 
         // New best move was found!
@@ -411,19 +424,19 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
 
                     // Move ordering heuristics from VICE
                     if (movesPlayed == 1)
-                        searchInfo.fhf++;
-                    searchInfo.fh++;
+                        thread->fhf++;
+                    thread->fh++;
 
                     // Quiet move heuristics
                     if (!IsCapture(move)) {
                         // Killers
-                        updateKillerMoves(move, ply);
+                        updateKillerMoves(thread, move, ply);
 
                         // Counter moves
-                        updateCounterMoves(board, move);
+                        updateCounterMoves(thread, move);
 
                         // History
-                        updateQuietHistory(move, ply, depth);
+                        updateQuietHistory(thread, move, ply, depth);
                     }
 
                     break;
@@ -444,18 +457,18 @@ static int search(Board *board, int alpha, int beta, int depth, PV *pv, int ply,
     }
 
     // The search has stopped, we must leave
-    if (searchInfo.stopped == true)
+    if (thread->info->stopped == true)
         return 0;
 
     // Store the results of this search in the hash table
-    hashTableStore(board->hash, bestMove, depth, bestScore, hashBound);
+    hashTableStore(thread->hashTable, board->hash, bestMove, depth, bestScore, eval, hashBound);
 
     return bestScore;
 }
 
 // My cursed implementation of aspiration windows
 // https://www.chessprogramming.org/Aspiration_Windows
-int aspirationWindow(Board *board, int score, int depth, PV *pv) {
+int aspirationWindow(SearchThread *thread, int score, int depth, PV *pv) {
     int alpha, beta;
 
     // Start window at the smallest size
@@ -467,7 +480,7 @@ int aspirationWindow(Board *board, int score, int depth, PV *pv) {
         beta = score + ASPIRATION_SIZES[betaIndex];
 
         // Search with current window
-        score = search(board, alpha, beta, depth, pv, 0, IS_PV, true);
+        score = search(thread, alpha, beta, depth, pv, 0, IS_PV, true);
 
         // Success
         if (score > alpha && score < beta)
@@ -486,96 +499,196 @@ int aspirationWindow(Board *board, int score, int depth, PV *pv) {
 }
 
 // Thank you VICE
-void clearForSearch() {
+static void clearForSearch(SearchThread *thread) {
     // Search debugging statistics
-    searchInfo.fh = 0;
-    searchInfo.fhf = 0;
-    searchInfo.hashAttempt = 0;
-    searchInfo.hashHit = 0;
+    thread->nodes = 0;
+    thread->fh = 0;
+    thread->fhf = 0;
+    thread->hashAttempt = 0;
+    thread->hashHit = 0;
+
+    // Nothing completed yet
+    thread->depth = 0;
+    thread->score = -INF;
+    thread->bestMove = NO_MOVE;
+    thread->pv.count = 0;
 
     // Clear search heuristics
-    clearKillerMoves();
-    clearHistoryHeuristics();
-    
-
-    // Update hash ages
-    updateHashAge();
+    clearKillerMoves(thread);
+    clearHistoryHeuristics(thread);
 }
 
-// Iterative deepening with aspiration windows
-void beginSearch(Board *board, SearchInfo *info) {
-    clearForSearch();
-
-    searchInfo = *info;
+// Prints the UCI info line for a completed iteration
+static void printSearchInfo(SearchThread *thread) {
+    int score = thread->score;
+    int timeElapsed = getTime() - thread->info->startTime + 1;
+    long nodes = totalNodes();
+    long nps = nodes * 1000 / timeElapsed;
+    int hashfull = hashFull();
+
+    if (abs(score) > MATE - 100) {
+        int pliesToMate = (MATE - abs(score));
+        int mateInMoves = (pliesToMate + 1) / 2;
+
+        printf("info depth %d score mate %d nodes %li nps %li hashfull %d time %d pv", thread->depth,
+                                                                                       score > 0 ? mateInMoves : -mateInMoves,
+                                                                                       nodes,
+                                                                                       nps,
+                                                                                       hashfull,
+                                                                                       timeElapsed);
+    } else {
+        printf("info depth %d score cp %d nodes %li nps %li hashfull %d time %d pv", thread->depth,
+                                                                                     score,
+                                                                                     nodes,
+                                                                                     nps,
+                                                                                     hashfull,
+                                                                                     timeElapsed);
+    }
 
-    int depthToSearch = searchInfo.depthToSearch;
+    // Print pv uci
+    for (int i = 0; i < thread->pv.count; i++) {
+        printf(" ");
+        printMove(thread->pv.moves[i], 0);
+    }
+    printf("\n");
+}
 
-    Move bestMove = NO_MOVE;
+// Iterative deepening
+// Every thread runs this, but only the main thread prints anything
+static void iterativeDeepening(SearchThread *thread) {
     PV pv;
     int score;
-    int timesFoundMate = 0;
 
-    // Begin iteratively deepening
-    for (int currentDepth = 1; currentDepth <= depthToSearch; currentDepth++) {
+    // Lazy SMP: half the helper threads start one ply deeper, so the
+    // threads aren't all searching the same depth at the same time
+    int startDepth = 1 + (thread->index & 1);
+
+    for (int currentDepth = startDepth; currentDepth <= thread->info->depthToSearch; currentDepth++) {
         // At the first few depths we use a normal full window search, then
         // the score is decently stable and we can use aspiration windows on deeper
         // depths for faster searching
         // if (currentDepth < 5)
-            score = search(board, -INF, INF, currentDepth, &pv, 0, IS_PV, true);
+            score = search(thread, -INF, INF, currentDepth, &pv, 0, IS_PV, true);
         // else
-        //     score = aspirationWindow(board, score, currentDepth, &pv);
+        //     score = aspirationWindow(thread, score, currentDepth, &pv);
 
         // Exit iterative deepening loop if we have run out of time or the user has quit
-        if (searchInfo.stopped || searchInfo.quit)
+        if (thread->info->stopped || thread->info->quit)
             break;
 
-        // Retrieve PV
-        bestMove = pv.moves[0];
-
-        int timeElapsed = getTime() - searchInfo.startTime + 1;
+        // Save the result of this iteration
+        thread->pv = pv;
+        thread->depth = currentDepth;
+        thread->score = score;
+        thread->bestMove = pv.moves[0];
 
         // UCI printing
-        if (abs(score) > MATE - 100) {
-            int pliesToMate = (MATE - abs(score));
-            int mateInMoves = (pliesToMate + 1) / 2;
-
-            printf("info depth %d score mate %d nodes %li time %d pv", currentDepth,
-                                                                       score > 0 ? mateInMoves : -mateInMoves,
-                                                                       searchInfo.nodes,
-                                                                       timeElapsed);
-
-            // timesFoundMate++;
-            // if (timesFoundMate > 4) searchInfo.stopped = true;
-        } else {
-            printf("info depth %d score cp %d nodes %li time %d pv", currentDepth,
-                                                                     score,
-                                                                     searchInfo.nodes,
-                                                                     timeElapsed);
-        }
+        if (thread->index == 0 && !thread->info->silent)
+            printSearchInfo(thread);
+    }
+}
 
-        // Print pv uci
-        for (int i = 0; i < pv.count; i++) {
-            printf(" ");
-            printMove(pv.moves[i], 0);
+static void *helperThreadSearch(void *arg) {
+    iterativeDeepening((SearchThread *)arg);
+    return NULL;
+}
+
+// Picks which thread's move we play
+// Each thread votes for its best move, weighted by depth and score
+// Credit: Stockfish
+static SearchThread *pickBestThread() {
+    SearchThread *best = &threads[0];
+    int minScore = INF;
+    long votes[MAX_THREADS] = {0};
+
+    if (threadCount == 1)
+        return best;
+
+    for (int i = 0; i < threadCount; i++) {
+        if (threads[i].depth > 0)
+            minScore = MIN(minScore, threads[i].score);
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        if (threads[i].depth == 0)
+            continue;
+
+        for (int j = 0; j < threadCount; j++) {
+            if (threads[j].depth > 0 && threads[j].bestMove == threads[i].bestMove)
+                votes[i] += (long)(threads[j].score - minScore + 14) * threads[j].depth;
         }
-        printf("\n");
     }
 
+    for (int i = 1; i < threadCount; i++) {
+        if (threads[i].depth == 0)
+            continue;
+
+        // Always take a found mate, otherwise go with the most votes
+        if (threads[i].score > MATE - 100 && threads[i].score > best->score)
+            best = &threads[i];
+        else if (best->score <= MATE - 100 && votes[i] > votes[best->index])
+            best = &threads[i];
+    }
+
+    return best;
+}
+
+// Lazy SMP search
+// All threads search the same root position sharing only the hash table,
+// the main thread handles time and input and stops the helpers when done
+void beginSearch(Board *board, SearchInfo *info) {
+    searchInfo = *info;
+
+    // Give every thread its own copy of the position
+    for (int i = 0; i < threadCount; i++) {
+        threads[i].board = *board;
+        threads[i].info = &searchInfo;
+        threads[i].hashTable = &hashTable;
+        clearForSearch(&threads[i]);
+    }
+
+    // Update hash ages
+    updateHashAge(&hashTable);
+
+    // Start helpers, then search on the main thread
+    for (int i = 1; i < threadCount; i++)
+        pthread_create(&threads[i].handle, NULL, helperThreadSearch, &threads[i]);
+
+    iterativeDeepening(&threads[0]);
+
+    // Main thread is done, so the helpers must stop too
+    searchInfo.stopped = true;
+    for (int i = 1; i < threadCount; i++)
+        pthread_join(threads[i].handle, NULL);
+
     if (!searchInfo.quit) {
+        SearchThread *best = pickBestThread();
+
+        // Report the line we are actually going to play
+        if (best != &threads[0])
+            printSearchInfo(best);
+
         printf("bestmove ");
-        printMove(bestMove, 1);
+        printMove(best->bestMove, 1);
 
-        // Debug statistics
-        printf("Ordering: %.2f %%\n", (searchInfo.fhf / searchInfo.fh) * 100);
+        // Debug statistics (main thread only)
+        printf("Ordering: %.2f %%\n", (threads[0].fhf / threads[0].fh) * 100);
         printf("Hash Table hit rate: %.2f %%\n",
-           (searchInfo.hashHit / searchInfo.hashAttempt) * 100);
-
-        double occupied = occupiedHashEntries();
-        printf("Hash Table occupancy: %.2f %%\n", (occupied) * 100);
+           (threads[0].hashHit / threads[0].hashAttempt) * 100);
 
     } else {
         // Free hash table then exit
         freeHashTable();
+        freeThreads();
         exit(0);
     }
 }
+
+// Searches thread->board on the calling thread alone, with whatever search
+// info and hash table the thread was given. Used for datagen, where every
+// game is its own independent search
+void searchSingleThread(SearchThread *thread) {
+    clearForSearch(thread);
+    updateHashAge(thread->hashTable);
+    iterativeDeepening(thread);
+}
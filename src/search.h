@@ -37,19 +37,24 @@ typedef struct {
     int endTime;
     int depthToSearch;
 
-    long nodes;
-
-    bool quit;
-    bool stopped;
+    // Stop once this many nodes have been searched, 0 for no limit. Counts
+    // every thread together when helpers are running, and only the thread's
+    // own nodes for datagen or single threaded searches
+    long nodeLimit;
+
+    // Read by every search thread, so they must not be cached
+    volatile bool quit;
+    volatile bool stopped;
     bool timeSet;
 
-    float fh;
-    float fhf;
-
-    float hashAttempt;
-    float hashHit;
+    // Datagen searches don't print, read input or check the clock
+    bool silent;
 
 } SearchInfo;
 
+// Defined in threads.h
+typedef struct SearchThread SearchThread;
+
 void beginSearch(Board *board, SearchInfo *info);
+void searchSingleThread(SearchThread *thread);
 void initLMRDepths();
@@ -0,0 +1,53 @@
+#include "threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "search.h"
+
+// Thread pool used by the search
+// threads[0] is the main thread, which also does all the UCI printing
+SearchThread *threads = NULL;
+int threadCount = 0;
+
+// (Re)allocates the search threads
+void initThreads(int count) {
+    if (count < 1)
+        count = 1;
+    if (count > MAX_THREADS)
+        count = MAX_THREADS;
+
+    freeThreads();
+
+    // Threads are big (mostly the history table), so they live on the heap
+    threads = (SearchThread *)calloc(count, sizeof(SearchThread));
+    if (threads == NULL) {
+        puts("Thread allocation failed.");
+        exit(1);
+    }
+
+    threadCount = count;
+    for (int i = 0; i < threadCount; i++)
+        threads[i].index = i;
+}
+
+void freeThreads() {
+    free(threads);
+    threads = NULL;
+    threadCount = 0;
+}
+
+// Forgets cached evaluations, e.g. when the evaluation itself changes
+void clearEvalCaches() {
+    for (int i = 0; i < threadCount; i++)
+        memset(&threads[i].evalCache, 0, sizeof(EvalCache));
+}
+
+// Sum of nodes searched by every thread
+long totalNodes() {
+    long nodes = 0;
+    for (int i = 0; i < threadCount; i++)
+        nodes += threads[i].nodes;
+    return nodes;
+}
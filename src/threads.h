@@ -0,0 +1,58 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "board.h"
+#include "eval.h"
+#include "hashtable.h"
+#include "move.h"
+#include "search.h"
+
+#define MAX_THREADS 256
+
+// Everything a single search thread owns
+// Helper threads get their own copy of the board and heuristics so that
+// the only thing shared between threads is the hash table
+struct SearchThread {
+    Board board;
+
+    // What to search and where to keep results, the global search info and
+    // hash table except in datagen
+    SearchInfo *info;
+    HashTable *hashTable;
+
+    // Move ordering heuristics
+    Move killerMoves[MAX_SEARCH_DEPTH][2];
+    int quietHistory[MAX_SEARCH_DEPTH][64][64];
+    Move counterMoves[2][NB_PIECES][64]; // [side][moved piece][to] (of last move)
+
+    // Evaluation caches
+    PawnHashTable pawnTable;
+    EvalCache evalCache;
+
+    // Search statistics
+    long nodes;
+
+    float fh;
+    float fhf;
+
+    float hashAttempt;
+    float hashHit;
+
+    // Result of the last completed iteration
+    PV pv;
+    int depth;
+    int score;
+    Move bestMove;
+
+    int index;
+    pthread_t handle;
+};
+
+extern SearchThread *threads;
+extern int threadCount;
+
+void initThreads(int count);
+void freeThreads();
+void clearEvalCaches();
+long totalNodes();
@@ -10,12 +10,17 @@
 #include "bitboards.h"
 #include "board.h"
 #include "engine.h"
+#include "eval.h"
+#include "hashtable.h"
 #include "magicmoves.h"
 #include "makemove.h"
 #include "move.h"
 #include "movegen.h"
 #include "movepicker.h"
+#include "nnue.h"
+#include "packed.h"
 #include "search.h"
+#include "threads.h"
 #include "timeman.h"
 #include "zobrist.h"
 
@@ -37,8 +42,9 @@ Move stringToMove(const char *string, Board *board) {
         flag |= KNIGHT_PROMO_FLAG;
     else if (string[4] == 'b')
         flag |= BISHOP_PROMO_FLAG;
+
     // Capture
-    else if (pieceCaptured != EMPTY)
+    if (pieceCaptured != EMPTY)
         flag |= CAPTURE_FLAG;
 
     // Castling
@@ -91,11 +97,13 @@ void uciPosition(Board *board, char *input) {
     if (token != NULL && strcmp(token, "moves") == 0) {
         token = strtok(NULL, " ");
         while (token != NULL) {
-            if (makeMove(board, stringToMove(token, board)) == 0) {
+            Move move = stringToMove(token, board);
+            if (!moveExists(board, move)) {
                 // Move was illegal, or my code was wrong..
                 printf("Move parsing error at: %s\n", token);
                 exit(1);
             }
+            makeMove(board, move);
             // Advance to next move
             token = strtok(NULL, " ");
         }
@@ -107,6 +115,7 @@ void uciGo(Board *board, char *input) {
 
     int depth = MAX_SEARCH_DEPTH - 1, movestogo = 30, movetime = -1;
     int time = -1, inc = 0;
+    long nodes = 0;
     char *ptr = NULL;
 
     if ((ptr = strstr(input, "infinite")))
@@ -140,13 +149,16 @@ void uciGo(Board *board, char *input) {
         depth = atoi(ptr + 6);
     }
 
+    if ((ptr = strstr(input, "nodes"))) {
+        nodes = atol(ptr + 6);
+    }
+
     SearchInfo info;
     info.startTime = getTime();
     info.endTime = info.startTime + timeToThink(time, inc, movestogo, movetime);
     info.depthToSearch = depth;
-    info.fh = 0;
-    info.fhf = 0;
-    info.nodes = 0;
+    info.nodeLimit = nodes;
+    info.silent = false;
 
     info.quit = false;
     info.stopped = false;
@@ -185,6 +197,64 @@ void uciPerft(Board *board, char *input) {
     }
 }
 
+// Parses 'setoption name [name] value [value]'
+void uciSetOption(char *input) {
+    char *name = strstr(input, "name ");
+    char *value = strstr(input, "value ");
+
+    if (name == NULL) {
+        puts("Usage: setoption name [name] value [value]");
+        return;
+    }
+    name += 5;
+
+    if (strncmp(name, "Hash", 4) == 0 && value != NULL) {
+        int sizeMB = atoi(value + 6);
+        initHashTable(MAX(1, MIN(sizeMB, MAX_HASH_MB)));
+    } else if (strncmp(name, "Clear Hash", 10) == 0) {
+        clearHashTable();
+        puts("info string Hash cleared");
+    } else if (strncmp(name, "Threads", 7) == 0 && value != NULL) {
+        initThreads(atoi(value + 6));
+        printf("info string Threads set to %d\n", threadCount);
+    } else if (strncmp(name, "EvalFile", 8) == 0 && value != NULL) {
+        if (loadNetwork(value + 6)) {
+            printf("info string Loaded network %s\n", value + 6);
+
+            // Anything evaluated by the old network is out of date
+            clearHashTable();
+            clearEvalCaches();
+        }
+    } else if (strncmp(name, "UseNNUE", 7) == 0 && value != NULL) {
+        bool enable = strncmp(value + 6, "true", 4) == 0;
+        if (enable && !networkLoaded()) {
+            puts("info string No network loaded, set EvalFile first");
+            enable = false;
+        }
+
+        // Stored evaluations came from the other evaluation
+        if (enable != useNNUE) {
+            useNNUE = enable;
+            clearHashTable();
+            clearEvalCaches();
+        }
+        printf("info string NNUE %s\n", useNNUE ? "enabled" : "disabled");
+    } else {
+        printf("Unknown option: '%s'\n", name);
+    }
+}
+
+// Runs a file converter on the two paths in input
+void uciConvert(char *input, int (*convert)(const char *, const char *)) {
+    char *inPath = strtok(input, " ");
+    char *outPath = strtok(NULL, " ");
+    if (inPath == NULL || outPath == NULL) {
+        puts("Expected an input and an output file");
+        return;
+    }
+    convert(inPath, outPath);
+}
+
 void uciLoop(Board *board) {
     /*
     Universal Chess Interface (UCI)
@@ -192,14 +262,29 @@ void uciLoop(Board *board) {
     UCI Commands implemented
         - uci => Prints some info about the engine and uciok
         - isready => Prints readyok and initialises engine internal state
-        - ucinewgame => Resets board to initial state
+        - ucinewgame => Resets board to initial state and clears the hash table
         - position [fen | startpos] moves ... => Sets the position
         - go => Searches position (WIP)
+        - setoption name [name] value [value] => Sets an engine option
+            - Hash => Hash table size in MB
+            - Clear Hash => Empties the hash table
+            - Threads => Number of search threads (Lazy SMP)
+            - EvalFile => Loads an NNUE network file, see nnue.h
+            - UseNNUE => Evaluates with the loaded network instead of the hand written evaluation
 
     Custom commands
         - print => prints an ascii representation of the board to the terminal
+        - eval => prints a breakdown of the static evaluation and the weight
+                  coefficients the tuner would see for the current position
         - perft [depth] => does a perft of that depth from the current board state
                            and benchmarks the speed
+        - savehash [file] => saves the hash table to a file
+        - loadhash [file] => replaces the hash table with one saved to a file
+        - pack [text file] [packed file] => converts 'FEN [result]' lines or EPDs
+                                            to packed positions, see packed.h
+        - unpack [packed file] [text file] => the other way round, writes EPDs
+                                              if the text file ends in .epd
+        - pickbench => measures the cost per move of picking moves in move ordering
     */
 
     char input[4000];
@@ -224,6 +309,11 @@ void uciLoop(Board *board) {
         if (strcmp(input, "uci") == 0) {
             printf("id name %s %s\n", NAME, VERSION);
             printf("id author %s\n", AUTHOR);
+            printf("option name Hash type spin default %d min 1 max %d\n", DEFAULT_HASH_MB, MAX_HASH_MB);
+            puts("option name Clear Hash type button");
+            printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+            puts("option name EvalFile type string default <empty>");
+            puts("option name UseNNUE type check default false");
             puts("uciok");
 
         } else if (strcmp(input, "isready") == 0) {
@@ -231,6 +321,7 @@ void uciLoop(Board *board) {
 
         } else if (strcmp(input, "ucinewgame") == 0) {
             parseFen(board, START_FEN);
+            clearHashTable();
 
         } else if (strncmp(input, "position", 8) == 0) {
             uciPosition(board, input);
@@ -238,6 +329,9 @@ void uciLoop(Board *board) {
         } else if (strncmp(input, "go", 2) == 0) {
             uciGo(board, input);
 
+        } else if (strncmp(input, "setoption", 9) == 0) {
+            uciSetOption(input);
+
         } else if (strcmp(input, "quit") == 0) {
             break;
         }
@@ -247,6 +341,18 @@ void uciLoop(Board *board) {
             uciPerft(board, input);
         } else if (strcmp(input, "print") == 0) {
             printBoard(board);
+        } else if (strcmp(input, "eval") == 0) {
+            printEvaluation(board);
+        } else if (strncmp(input, "savehash ", 9) == 0) {
+            saveHashTable(input + 9);
+        } else if (strncmp(input, "loadhash ", 9) == 0) {
+            loadHashTable(input + 9);
+        } else if (strncmp(input, "pack ", 5) == 0) {
+            uciConvert(input + 5, convertTextToPacked);
+        } else if (strncmp(input, "unpack ", 7) == 0) {
+            uciConvert(input + 7, convertPackedToText);
+        } else if (strcmp(input, "pickbench") == 0) {
+            benchMovePicker();
         }
 
         /* No commands hit, so unknown */
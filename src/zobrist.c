@@ -39,6 +39,22 @@ U64 generateHash(Board *board) {
     return hash;
 }
 
+// Generates the zobrist hash of only the pawns on a board
+U64 generatePawnHash(Board *board) {
+    U64 hash = 0ULL;
+
+    U64 pawns = board->pieces[PAWN];
+    while (pawns) {
+        int sq = poplsb(&pawns);
+        if (testBit(board->colors[WHITE], sq))
+            hash ^= PieceKeys[toPiece(PAWN, WHITE)][sq];
+        else
+            hash ^= PieceKeys[toPiece(PAWN, BLACK)][sq];
+    }
+
+    return hash;
+}
+
 // XOR shift algorithm shamelessly stolen from Wikipedia
 // https://en.wikipedia.org/wiki/Xorshift
 U64 randomU64() {
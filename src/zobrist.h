@@ -9,4 +9,5 @@ extern U64 CastleKeys[16];
 extern U64 SideKey;
 
 U64 generateHash(Board *board);
+U64 generatePawnHash(Board *board);
 void initZobristKeys();
@@ -0,0 +1,474 @@
+/*
+    PGN to training data converter
+
+    Replays every game in a PGN with the engine's own move generator and
+    makeMove() and writes the quiet positions, labelled with the game
+    result, as packed positions (see packed.h) for the tuner.
+
+    Build it with 'make pgn' in src/.
+
+    Usage: pgnconvert [pgn file] [output file] [threads]
+
+    The PGN is mapped into memory and cut into chunks on game boundaries,
+    which the threads take in turn. A position is kept if more than
+    MIN_PLIES plies have been played, the side to move isn't in check, has
+    a legal move and has nothing to capture.
+*/
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "bitboards.h"
+#include "board.h"
+#include "eval.h"
+#include "magicmoves.h"
+#include "makemove.h"
+#include "move.h"
+#include "movegen.h"
+#include "packed.h"
+#include "timeman.h"
+#include "zobrist.h"
+
+#define MAX_WORKERS 256
+#define CHUNK_SIZE (4 * 0x100000)
+#define BUFFER_SIZE 4096
+#define MIN_PLIES 10
+
+// Shared between the workers
+static const char *pgn;
+static uint64_t pgnSize;
+static uint64_t chunkCount;
+static uint64_t nextChunk = 0;
+
+static PackedWriter writer;
+static pthread_mutex_t writeLock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    Board *board;
+
+    // Current game
+    int result;   // Packed result, -1 if unknown
+    int plies;
+    bool skip;    // Rest of the game is ignored after a bad move
+    bool inMoves; // Past the tags
+
+    PackedPosition buffer[BUFFER_SIZE];
+    int buffered;
+
+    // Statistics
+    long games;
+    long positions;
+    long errors;
+
+    pthread_t handle;
+} Worker;
+
+static Worker workers[MAX_WORKERS];
+
+/* Output */
+
+static void flushBuffer(Worker *worker) {
+    pthread_mutex_lock(&writeLock);
+    if (!writePackedPositions(&writer, worker->buffer, worker->buffered)) {
+        puts("Failed to write positions.");
+        exit(1);
+    }
+    pthread_mutex_unlock(&writeLock);
+
+    worker->positions += worker->buffered;
+    worker->buffered = 0;
+}
+
+// Whether the side to move could capture anything, ignoring legality
+static bool hasCapture(Board *board) {
+    AttackInfo *info = getAttackInfo(board);
+    if (info->attacked[board->side] & board->colors[!board->side])
+        return true;
+
+    U64 ourPawns = board->pieces[PAWN] & board->colors[board->side];
+    return board->epSquare != NO_SQ && (pawnAttacks(!board->side, board->epSquare) & ourPawns);
+}
+
+static void considerPosition(Worker *worker) {
+    Board *board = worker->board;
+    if (worker->plies <= MIN_PLIES || attackersToKingSquare(board) != 0ULL)
+        return;
+
+    MoveList moves;
+    moves.count = 0;
+    generateLegalMoves(&moves, board);
+    if (moves.count == 0 || hasCapture(board))
+        return;
+
+    packPosition(board, worker->result, PACKED_NO_SCORE, &worker->buffer[worker->buffered++]);
+    if (worker->buffered == BUFFER_SIZE)
+        flushBuffer(worker);
+}
+
+/* SAN */
+
+static int pieceFromChar(char c) {
+    switch (c) {
+    case 'N': return KNIGHT;
+    case 'B': return BISHOP;
+    case 'R': return ROOK;
+    case 'Q': return QUEEN;
+    case 'K': return KING;
+    default: return NO_PIECE;
+    }
+}
+
+// Finds the legal move a SAN token describes, NO_MOVE if there isn't
+// exactly one
+static Move parseSan(Board *board, const char *token, int length) {
+    char san[16];
+    int n = 0;
+
+    // Drop check marks, annotations and capture/promotion punctuation
+    for (int i = 0; i < length && n < 15; i++) {
+        if (!strchr("+#!?x:=", token[i]))
+            san[n++] = token[i];
+    }
+    san[n] = '\0';
+
+    MoveList moves;
+    moves.count = 0;
+    generateLegalMoves(&moves, board);
+
+    // Castling, with letters or zeroes
+    if (san[0] == 'O' || san[0] == '0') {
+        bool queenside = n >= 5;
+        for (int i = 0; i < moves.count; i++) {
+            Move move = moves.list[i];
+            if (IsCastling(move) && (MoveTo(move) < MoveFrom(move)) == queenside)
+                return move;
+        }
+        return NO_MOVE;
+    }
+
+    int piece = pieceFromChar(san[0]);
+    const char *p = san;
+    if (piece != NO_PIECE)
+        p++;
+    else
+        piece = PAWN;
+
+    // Promotion piece at the end, like e8Q once the '=' is gone
+    int promoted = NO_PIECE;
+    if (n >= 3 && piece == PAWN && pieceFromChar(san[n - 1]) != NO_PIECE) {
+        promoted = pieceFromChar(san[n - 1]);
+        san[--n] = '\0';
+    }
+
+    // Destination is always the last square
+    int end = n - (p - san);
+    if (end < 2)
+        return NO_MOVE;
+    const char *dest = p + end - 2;
+    if (dest[0] < 'a' || dest[0] > 'h' || dest[1] < '1' || dest[1] > '8')
+        return NO_MOVE;
+    int to = squareFrom(dest[0] - 'a', dest[1] - '1');
+
+    // Anything between the piece and the destination disambiguates
+    int fromFile = -1, fromRank = -1;
+    for (const char *c = p; c < dest; c++) {
+        if (*c >= 'a' && *c <= 'h')
+            fromFile = *c - 'a';
+        else if (*c >= '1' && *c <= '8')
+            fromRank = *c - '1';
+        else if (*c != '-')
+            return NO_MOVE;
+    }
+
+    Move found = NO_MOVE;
+    for (int i = 0; i < moves.count; i++) {
+        Move move = moves.list[i];
+        int from = MoveFrom(move);
+
+        if (MoveTo(move) != to || board->squares[from] != piece || IsCastling(move))
+            continue;
+        if ((fromFile >= 0 && fileOf(from) != fromFile) || (fromRank >= 0 && rankOf(from) != fromRank))
+            continue;
+
+        // A promotion without a piece is taken to be a queen
+        if (IsPromotion(move) && MovePromotedPiece(move) != (promoted == NO_PIECE ? QUEEN : promoted))
+            continue;
+        if (!IsPromotion(move) && promoted != NO_PIECE)
+            continue;
+
+        if (found != NO_MOVE)
+            return NO_MOVE;
+        found = move;
+    }
+    return found;
+}
+
+/* PGN */
+
+static void startGame(Worker *worker) {
+    parseFen(worker->board, START_FEN);
+    worker->result = -1;
+    worker->plies = 0;
+    worker->skip = false;
+    worker->inMoves = false;
+    worker->games++;
+}
+
+// Reads a [Name "Value"] tag, returns where it ends
+static const char *parseTag(Worker *worker, const char *p, const char *end) {
+    const char *close = memchr(p, ']', end - p);
+    if (close == NULL)
+        return end;
+
+    const char *name = p + 1;
+    const char *quote = memchr(p, '"', close - p);
+    if (quote == NULL)
+        return close + 1;
+
+    const char *value = quote + 1;
+    const char *valueEnd = memchr(value, '"', close - value);
+    if (valueEnd == NULL)
+        valueEnd = close;
+    int length = valueEnd - value;
+
+    if (strncmp(name, "Result ", 7) == 0) {
+        if (length == 3 && strncmp(value, "1-0", 3) == 0)
+            worker->result = 2;
+        else if (length == 3 && strncmp(value, "0-1", 3) == 0)
+            worker->result = 0;
+        else if (length == 7 && strncmp(value, "1/2-1/2", 7) == 0)
+            worker->result = 1;
+    } else if (strncmp(name, "FEN ", 4) == 0 && length < 128) {
+        char fen[128];
+        memcpy(fen, value, length);
+        fen[length] = '\0';
+        parseFen(worker->board, fen);
+    }
+
+    return close + 1;
+}
+
+// Skips a brace comment or a (possibly nested) variation
+static const char *skipBlock(const char *p, const char *end) {
+    int depth = 0;
+    bool comment = false;
+    for (; p < end; p++) {
+        if (comment) {
+            if (*p == '}')
+                comment = false;
+        } else if (*p == '{') {
+            comment = true;
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        }
+
+        if (!comment && depth == 0)
+            return p + 1;
+    }
+    return end;
+}
+
+static void playToken(Worker *worker, const char *token, int length) {
+    Board *board = worker->board;
+    if (worker->skip || worker->result < 0)
+        return;
+
+    // History is kept for every ply of the game
+    if (board->ply >= MAX_MOVES - 1) {
+        worker->skip = true;
+        return;
+    }
+
+    Move move = parseSan(board, token, length);
+    if (move == NO_MOVE) {
+        worker->errors++;
+        worker->skip = true;
+        return;
+    }
+
+    makeMove(board, move);
+    worker->plies++;
+    considerPosition(worker);
+}
+
+// Converts every game in [p, end)
+static void parseGames(Worker *worker, const char *p, const char *end) {
+    bool started = false;
+
+    while (p < end) {
+        char c = *p;
+
+        if (isspace((unsigned char)c)) {
+            p++;
+        } else if (c == '[') {
+            // Tags after moves belong to the next game
+            if (!started || worker->inMoves) {
+                startGame(worker);
+                started = true;
+            }
+            p = parseTag(worker, p, end);
+        } else if (c == '{' || c == '(') {
+            p = skipBlock(p, end);
+        } else if (c == ';' || (c == '%' && (p == pgn || p[-1] == '\n'))) {
+            // Rest of line comments and escapes
+            const char *newline = memchr(p, '\n', end - p);
+            p = newline ? newline + 1 : end;
+        } else {
+            const char *start = p;
+            while (p < end && !isspace((unsigned char)*p) && !strchr("{}();[", *p))
+                p++;
+            int length = p - start;
+
+            if (!started) {
+                startGame(worker);
+                started = true;
+            }
+            worker->inMoves = true;
+
+            // NAGs and the game termination markers
+            if (c == '$' || c == '*' || (length >= 3 && strncmp(start, "1/2", 3) == 0)
+                || (length == 3 && (strncmp(start, "1-0", 3) == 0 || strncmp(start, "0-1", 3) == 0)))
+                continue;
+
+            // Move numbers, which may be stuck to the move as in 12.e4
+            // Castling written with zeroes has no dot, so it's left alone
+            int digits = 0;
+            while (digits < length && isdigit((unsigned char)start[digits]))
+                digits++;
+            if (digits < length && start[digits] == '.') {
+                while (digits < length && start[digits] == '.')
+                    digits++;
+                start += digits;
+                length -= digits;
+            }
+
+            if (length > 0)
+                playToken(worker, start, length);
+        }
+    }
+}
+
+// Start of the first game at or after offset
+static uint64_t gameBoundary(uint64_t offset) {
+    if (offset == 0)
+        return 0;
+
+    const char *p = pgn + offset;
+    const char *end = pgn + pgnSize;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        p++;
+        if (end - p >= 7 && memcmp(p, "[Event ", 7) == 0)
+            return p - pgn;
+    }
+    return pgnSize;
+}
+
+static void *converterWorker(void *arg) {
+    Worker *worker = (Worker *)arg;
+
+    // Boards are big, so each worker gets one on the heap
+    worker->board = malloc(sizeof(Board));
+    if (worker->board == NULL) {
+        puts("Board allocation failed.");
+        exit(1);
+    }
+
+    uint64_t chunk;
+    while ((chunk = __atomic_fetch_add(&nextChunk, 1, __ATOMIC_RELAXED)) < chunkCount) {
+        uint64_t start = gameBoundary(chunk * CHUNK_SIZE);
+        uint64_t end = gameBoundary(MIN((chunk + 1) * CHUNK_SIZE, pgnSize));
+        if (start < end)
+            parseGames(worker, pgn + start, pgn + end);
+    }
+
+    if (worker->buffered > 0)
+        flushBuffer(worker);
+    free(worker->board);
+    return NULL;
+}
+
+static int mapPgn(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Could not open '%s'\n", path);
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    pgnSize = ftell(file);
+    if (pgnSize == 0) {
+        fclose(file);
+        return 1;
+    }
+
+#ifdef __linux__
+    char *mapping = mmap(NULL, pgnSize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    fclose(file);
+    if (mapping == MAP_FAILED) {
+        printf("Could not map '%s'\n", path);
+        return 0;
+    }
+
+    // Every chunk is read front to back
+    madvise(mapping, pgnSize, MADV_SEQUENTIAL);
+    pgn = mapping;
+#else
+    char *memory = malloc(pgnSize);
+    fseek(file, 0, SEEK_SET);
+    if (memory == NULL || fread(memory, 1, pgnSize, file) != pgnSize) {
+        printf("Failed to read '%s'\n", path);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    pgn = memory;
+#endif
+
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *pgnPath = argc > 1 ? argv[1] : "games.pgn";
+    const char *outPath = argc > 2 ? argv[2] : "data.bin";
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    threads = MAX(1, MIN(threads, MAX_WORKERS));
+
+    initAttackMasks();
+    initZobristKeys();
+    initmagicmoves();
+    initPSQT();
+
+    int startTime = getTime();
+    if (!mapPgn(pgnPath) || !openPackedWriter(&writer, outPath))
+        return 1;
+
+    chunkCount = (pgnSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    for (int i = 0; i < threads; i++)
+        pthread_create(&workers[i].handle, NULL, converterWorker, &workers[i]);
+
+    long games = 0, errors = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].handle, NULL);
+        games += workers[i].games;
+        errors += workers[i].errors;
+    }
+
+    if (!closePackedWriter(&writer)) {
+        printf("Failed to write '%s'\n", outPath);
+        return 1;
+    }
+
+    double seconds = (getTime() - startTime + 1) / 1000.0;
+    printf("%ld games, %lu positions, %ld games with bad moves\n", games, writer.count, errors);
+    printf("%.1fs, %.0f games/s, %.1f MB/s\n", seconds, games / seconds, pgnSize / seconds / 0x100000);
+    return 0;
+}
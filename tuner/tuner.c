@@ -0,0 +1,630 @@
+/*
+    Texel tuner
+
+    Fits the evaluation weights to game results with batch gradient descent
+    (Adam). Build it with 'make tune' in src/. Positions are traced with the
+    engine's own evaluation (see traceEvaluation() in eval.c) when they're
+    loaded and kept as a sparse list of how often each weight was used,
+    after which the evaluation is just a dot product with the weights.
+
+    Usage: tuner [data file] [weights in] [weights out] [epochs] [threads] [max positions]
+
+    Each line of the data file is a FEN followed by the result of the game
+    from white's point of view, e.g. '... w - - 0 1 [0.5]'. Files ending in
+    .bin are read as packed positions instead (see packed.h), which are
+    mapped in rather than parsed and are loaded in a random order, so max
+    positions picks a random sample. Weights are read
+    from and written to the weights.json layout. Terms missing from the
+    weights file start from the engine's current values, and the tuned
+    values are also printed as eval.h tables at the end.
+*/
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitboards.h"
+#include "board.h"
+#include "eval.h"
+#include "magicmoves.h"
+#include "packed.h"
+#include "zobrist.h"
+
+#define NB_TERMS NB_TRACE_TERMS
+#define MAX_THREADS 256
+#define LOAD_CHUNK 4096
+
+#define BATCH_SIZE 16384
+#define LEARNING_RATE 0.5
+#define BETA1 0.9
+#define BETA2 0.999
+#define EPSILON 1e-8
+
+// How each group of EvalTrace terms is stored in weights.json
+// Split terms have separate middlegame and endgame keys, the others keep
+// the middlegame row followed by the endgame row under one key. Tied
+// terms are a single number used for both halves.
+typedef struct {
+    const char *key;
+    const char *egKey;
+    int count;
+    bool tied;
+} TermLayout;
+
+// Must be in the same order as the fields of EvalTrace
+static const TermLayout layouts[] = {
+    {"mat_mg", "mat_eg", NB_PIECES, false},
+    {"pst_mg", "pst_eg", NB_PIECES * 64, false},
+    {"mob_bonus", NULL, NB_PIECES, false},
+    {"king_atk_bonus", NULL, NB_PIECES, false},
+    {"passed_pawn_bonus", NULL, 8, false},
+    {"isolated_pawn_penalty", NULL, 1, false},
+    {"doubled_pawn_penalty", NULL, 1, false},
+    {"backward_pawn_penalty", NULL, 1, false},
+    {"connected_pawn_bonus", NULL, 1, false},
+    {"bishop_pair_bonus", NULL, 1, true},
+    {"stm_bonus", NULL, 1, true},
+};
+#define NB_LAYOUTS ((int)(sizeof(layouts) / sizeof(layouts[0])))
+
+typedef struct {
+    uint16_t index;
+    int16_t coef; // White's count minus black's
+} Coefficient;
+
+typedef struct {
+    size_t offset; // Into the coefficient pool
+    int count;
+    int phase;
+    double result;
+} Position;
+
+// Dataset
+static Position *positions = NULL;
+static int positionCount = 0;
+static Coefficient *pool = NULL;
+static size_t poolSize = 0;
+static int mismatches = 0;
+
+// Weights being tuned, [term][middlegame/endgame]
+static double params[NB_TERMS][2];
+static bool tied[NB_TERMS];
+
+// Adam state
+static double momentum[NB_TERMS][2];
+static double velocity[NB_TERMS][2];
+
+static double K = 1.0;
+static int tunerThreads = 1;
+
+// Engine's current values, in EvalTrace order
+static void initParams() {
+    Score values[NB_TERMS];
+    traceWeights(values);
+
+    int term = 0;
+    for (int layout = 0; layout < NB_LAYOUTS; layout++)
+        for (int j = 0; j < layouts[layout].count; j++)
+            tied[term++] = layouts[layout].tied;
+
+    if (term != NB_TERMS) {
+        puts("Tuner terms don't match the evaluation trace.");
+        exit(1);
+    }
+
+    for (int i = 0; i < NB_TERMS; i++) {
+        params[i][middlegame] = ScoreMG(values[i]);
+        params[i][endgame] = ScoreEG(values[i]);
+    }
+}
+
+/* Weights file */
+
+static char *readFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *text = malloc(size + 1);
+    if (text == NULL || fread(text, 1, size, file) != (size_t)size) {
+        puts("Could not read weights file.");
+        exit(1);
+    }
+    text[size] = '\0';
+    fclose(file);
+    return text;
+}
+
+// Reads the number or (nested) array of numbers under key
+// Returns how many numbers were read, -1 if the key isn't there
+static int readJsonNumbers(const char *json, const char *key, double *values, int max) {
+    char quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+
+    const char *p = strstr(json, quoted);
+    if (p == NULL)
+        return -1;
+    p = strchr(p + strlen(quoted), ':');
+    if (p == NULL)
+        return -1;
+    p++;
+
+    int count = 0;
+    int depth = 0;
+    while (*p) {
+        if (*p == '[') {
+            depth++;
+            p++;
+        } else if (*p == ']') {
+            if (--depth == 0)
+                break;
+            p++;
+        } else if (*p == '-' || isdigit((unsigned char)*p)) {
+            char *end;
+            double value = strtod(p, &end);
+            if (count < max)
+                values[count] = value;
+            count++;
+            p = end;
+
+            // A plain number rather than an array
+            if (depth == 0)
+                break;
+        } else if (depth == 0 && !isspace((unsigned char)*p)) {
+            break;
+        } else {
+            p++;
+        }
+    }
+    return count;
+}
+
+static void loadWeights(const char *path) {
+    char *json = readFile(path);
+    if (json == NULL) {
+        printf("Could not open '%s', starting from the engine's weights\n", path);
+        return;
+    }
+
+    double values[2 * NB_PIECES * 64];
+    int term = 0;
+    for (int layout = 0; layout < NB_LAYOUTS; layout++) {
+        const TermLayout *l = &layouts[layout];
+
+        if (l->tied) {
+            if (readJsonNumbers(json, l->key, values, 1) == 1)
+                params[term][middlegame] = params[term][endgame] = values[0];
+        } else if (l->egKey != NULL) {
+            if (readJsonNumbers(json, l->key, values, l->count) == l->count)
+                for (int i = 0; i < l->count; i++)
+                    params[term + i][middlegame] = values[i];
+            if (readJsonNumbers(json, l->egKey, values, l->count) == l->count)
+                for (int i = 0; i < l->count; i++)
+                    params[term + i][endgame] = values[i];
+        } else if (readJsonNumbers(json, l->key, values, 2 * l->count) == 2 * l->count) {
+            for (int i = 0; i < l->count; i++) {
+                params[term + i][middlegame] = values[i];
+                params[term + i][endgame] = values[l->count + i];
+            }
+        }
+
+        term += l->count;
+    }
+
+    // Kings are always on the board so their material never matters, and
+    // the engine needs it to fit in 16 bits
+    params[KING][middlegame] = params[KING][endgame] = 0;
+
+    free(json);
+    printf("Loaded weights from '%s'\n", path);
+}
+
+static void writeJsonArray(FILE *file, const char *key, double *values, int count, int perLine, bool last) {
+    fprintf(file, "    \"%s\" : [\n", key);
+    for (int i = 0; i < count; i++) {
+        if (i % perLine == 0)
+            fprintf(file, "        ");
+        fprintf(file, "%3d%s", (int)lround(values[i]), i == count - 1 ? "" : ",");
+        fprintf(file, (i % perLine == perLine - 1 || i == count - 1) ? "\n" : " ");
+
+        // Blank line between the piece square tables
+        if (count == NB_PIECES * 64 && i % 64 == 63 && i != count - 1)
+            fprintf(file, "\n");
+    }
+    fprintf(file, "    ]%s\n", last ? "" : ",");
+}
+
+static void saveWeights(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Could not write '%s'\n", path);
+        return;
+    }
+
+    double values[2 * NB_PIECES * 64];
+    int term = 0;
+    fprintf(file, "{\n");
+    for (int layout = 0; layout < NB_LAYOUTS; layout++) {
+        const TermLayout *l = &layouts[layout];
+        bool last = layout == NB_LAYOUTS - 1;
+        int perLine = l->count == NB_PIECES * 64 ? 8 : l->count;
+
+        if (l->tied) {
+            fprintf(file, "    \"%s\" : %d%s\n", l->key, (int)lround(params[term][middlegame]), last ? "" : ",");
+        } else if (l->egKey != NULL) {
+            for (int i = 0; i < l->count; i++)
+                values[i] = params[term + i][middlegame];
+            writeJsonArray(file, l->key, values, l->count, perLine, false);
+            for (int i = 0; i < l->count; i++)
+                values[i] = params[term + i][endgame];
+            writeJsonArray(file, l->egKey, values, l->count, perLine, last);
+        } else {
+            for (int i = 0; i < l->count; i++) {
+                values[i] = params[term + i][middlegame];
+                values[l->count + i] = params[term + i][endgame];
+            }
+            writeJsonArray(file, l->key, values, 2 * l->count, perLine, last);
+        }
+
+        term += l->count;
+    }
+    fprintf(file, "}\n");
+    fclose(file);
+}
+
+// Prints the weights as they'd appear in eval.h
+static void printScores(const char *name, int first, int count, int perLine) {
+    const char *pieceNames[NB_PIECES] = {"Pawns", "Knights", "Bishops", "Rooks", "Queens", "King"};
+
+    printf("static const Score %s = {\n", name);
+    for (int i = 0; i < count; i++) {
+        if (count == NB_PIECES * 64 && i % 64 == 0)
+            printf("    // %s\n", pieceNames[i / 64]);
+        if (i % perLine == 0)
+            printf("   ");
+        printf(" S(%3d, %3d),", (int)lround(params[first + i][middlegame]), (int)lround(params[first + i][endgame]));
+        if (i % perLine == perLine - 1 || i == count - 1)
+            printf("\n");
+    }
+    printf("};\n\n");
+}
+
+static void printWeights() {
+    int term = 0;
+    printScores("PieceValues[NB_PIECES]", term, NB_PIECES, NB_PIECES);
+    term += NB_PIECES;
+    printScores("PieceSquareTables[NB_PIECES][64]", term, NB_PIECES * 64, 8);
+    term += NB_PIECES * 64;
+    printScores("mobilityBonus[NB_PIECES]", term, NB_PIECES, NB_PIECES);
+    term += NB_PIECES;
+    printScores("kingAttackBonus[NB_PIECES]", term, NB_PIECES, NB_PIECES);
+    term += NB_PIECES;
+    printScores("passedPawnBonus[8]", term, 8, 8);
+    term += 8;
+
+    const char *defines[] = {
+        "ISOLATED_PAWN_PENALTY", "DOUBLED_PAWN_PENALTY", "BACKWARD_PAWN_PENALTY", "CONNECTED_PAWN_BONUS", "BISHOP_PAIR_BONUS",
+    };
+    for (int i = 0; i < 5; i++, term++)
+        printf("#define %s S(%d, %d)\n", defines[i], (int)lround(params[term][middlegame]), (int)lround(params[term][endgame]));
+    printf("#define STM_BONUS %d\n", (int)lround(params[term][middlegame]));
+}
+
+/* Dataset */
+
+static void addCoefficient(uint16_t index, int16_t coef) {
+    static size_t capacity = 0;
+    if (poolSize == capacity) {
+        capacity = capacity ? capacity * 2 : 1 << 20;
+        pool = realloc(pool, capacity * sizeof(Coefficient));
+        if (pool == NULL) {
+            puts("Coefficient allocation failed.");
+            exit(1);
+        }
+    }
+    pool[poolSize++] = (Coefficient){index, coef};
+}
+
+// The evaluation rebuilt from a position's coefficients, from white's
+// point of view
+static double linearEvaluation(Position *position) {
+    double mg = 0, eg = 0;
+    Coefficient *coefs = &pool[position->offset];
+    for (int i = 0; i < position->count; i++) {
+        mg += coefs[i].coef * params[coefs[i].index][middlegame];
+        eg += coefs[i].coef * params[coefs[i].index][endgame];
+    }
+    return (mg * position->phase + eg * (START_PHASE - position->phase)) / START_PHASE;
+}
+
+static void addPosition(EvalTrace *trace, double result) {
+    static int capacity = 0;
+    if (positionCount == capacity) {
+        capacity = capacity ? capacity * 2 : 1 << 16;
+        positions = realloc(positions, capacity * sizeof(Position));
+        if (positions == NULL) {
+            puts("Position allocation failed.");
+            exit(1);
+        }
+    }
+
+    Position *position = &positions[positionCount++];
+    position->offset = poolSize;
+    position->count = 0;
+    position->phase = trace->phase;
+    position->result = result;
+
+    for (int i = 0; i < NB_TERMS; i++) {
+        int coef = traceCoefficient(trace, i);
+        if (coef != 0) {
+            addCoefficient(i, coef);
+            position->count++;
+        }
+    }
+
+    // With the engine's own weights the rebuilt evaluation should be
+    // exact, apart from the engine rounding down when it tapers
+    if (fabs(linearEvaluation(position) - trace->eval) > 1.0)
+        mismatches++;
+
+    if (positionCount % 1000000 == 0)
+        printf("Loaded %d positions\n", positionCount);
+}
+
+static void loadPositions(const char *path, int maxPositions) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Could not open '%s'\n", path);
+        exit(1);
+    }
+
+    // Lines are read and traced a chunk at a time
+    static char lines[LOAD_CHUNK][512];
+    static char *fens[LOAD_CHUNK];
+    static double results[LOAD_CHUNK];
+    static EvalTrace traces[LOAD_CHUNK];
+    bool done = false;
+
+    while (!done) {
+        int count = 0;
+        while (count < LOAD_CHUNK && positionCount + count < maxPositions) {
+            char *line = lines[count];
+            if (!fgets(line, sizeof(lines[count]), file)) {
+                done = true;
+                break;
+            }
+
+            // The result is the last word on the line, possibly in brackets
+            line[strcspn(line, "\r\n")] = '\0';
+            char *split = strrchr(line, ' ');
+            if (split == NULL)
+                continue;
+            *split = '\0';
+            char *resultText = split + 1;
+            if (*resultText == '[')
+                resultText++;
+
+            fens[count] = line;
+            results[count] = strtod(resultText, NULL);
+            count++;
+        }
+        if (positionCount + count >= maxPositions)
+            done = true;
+
+        count = traceEvaluations(fens, count, traces);
+        for (int i = 0; i < count; i++)
+            addPosition(&traces[i], results[i]);
+    }
+    fclose(file);
+}
+
+static void loadPackedPositions(const char *path, int maxPositions) {
+    PackedFile file;
+    if (!openPackedFile(&file, path))
+        exit(1);
+
+    // Boards are big, don't put one on the stack
+    static Board board;
+    EvalTrace trace;
+    const PackedPosition *packed;
+
+    shufflePackedFile(&file, 0x9E3779B97F4A7C15ULL);
+    while (positionCount < maxPositions && (packed = nextPackedPosition(&file)) != NULL) {
+        if (!unpackPosition(packed, &board)) {
+            printf("Skipping corrupt record %lu in '%s'\n", (uint64_t)(packed - file.positions), path);
+            continue;
+        }
+        traceEvaluation(&board, &trace);
+        addPosition(&trace, packed->result / 2.0);
+    }
+    closePackedFile(&file);
+}
+
+// Shuffled once so batches are a fair sample of the whole dataset
+static void shufflePositions() {
+    for (int i = positionCount - 1; i > 0; i--) {
+        int j = (int)(((uint64_t)rand() * RAND_MAX + rand()) % (i + 1));
+        Position temp = positions[i];
+        positions[i] = positions[j];
+        positions[j] = temp;
+    }
+}
+
+/* Gradient descent */
+
+static inline double sigmoid(double eval) {
+    return 1.0 / (1.0 + pow(10.0, -K * eval / 400.0));
+}
+
+typedef struct {
+    int start, end;
+    double error;
+    double gradient[NB_TERMS][2];
+} Job;
+
+static void *errorWorker(void *arg) {
+    Job *job = arg;
+    job->error = 0;
+    for (int i = job->start; i < job->end; i++) {
+        double error = positions[i].result - sigmoid(linearEvaluation(&positions[i]));
+        job->error += error * error;
+    }
+    return NULL;
+}
+
+static void *gradientWorker(void *arg) {
+    Job *job = arg;
+    memset(job->gradient, 0, sizeof(job->gradient));
+
+    for (int i = job->start; i < job->end; i++) {
+        Position *position = &positions[i];
+        double s = sigmoid(linearEvaluation(position));
+
+        // Derivative of the squared error with respect to the evaluation
+        double slope = -2.0 * (position->result - s) * s * (1.0 - s) * K * log(10.0) / 400.0;
+        double mgSlope = slope * position->phase / START_PHASE;
+        double egSlope = slope * (START_PHASE - position->phase) / START_PHASE;
+
+        Coefficient *coefs = &pool[position->offset];
+        for (int j = 0; j < position->count; j++) {
+            job->gradient[coefs[j].index][middlegame] += mgSlope * coefs[j].coef;
+            job->gradient[coefs[j].index][endgame] += egSlope * coefs[j].coef;
+        }
+    }
+    return NULL;
+}
+
+static Job jobs[MAX_THREADS];
+
+// Splits [start, end) between the threads and runs worker on each part
+static void runJobs(void *(*worker)(void *), int start, int end) {
+    pthread_t handles[MAX_THREADS];
+    int size = (end - start + tunerThreads - 1) / tunerThreads;
+
+    for (int i = 0; i < tunerThreads; i++) {
+        jobs[i].start = MIN(start + i * size, end);
+        jobs[i].end = MIN(start + (i + 1) * size, end);
+        pthread_create(&handles[i], NULL, worker, &jobs[i]);
+    }
+    for (int i = 0; i < tunerThreads; i++)
+        pthread_join(handles[i], NULL);
+}
+
+static double meanSquaredError() {
+    runJobs(errorWorker, 0, positionCount);
+
+    double total = 0;
+    for (int i = 0; i < tunerThreads; i++)
+        total += jobs[i].error;
+    return total / positionCount;
+}
+
+// K scales evaluations to win probabilities, and is fitted once up front
+static void computeOptimalK() {
+    double best = meanSquaredError();
+    for (double step = 0.1; step > 0.0001; step /= 10) {
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            for (int sign = -1; sign <= 1; sign += 2) {
+                K += sign * step;
+                double error = meanSquaredError();
+                if (error < best) {
+                    best = error;
+                    improved = true;
+                    break;
+                }
+                K -= sign * step;
+            }
+        }
+    }
+    printf("Optimal K %.4f, error %.6f\n", K, best);
+}
+
+static void adamStep(int batchStart, int batchEnd, int step) {
+    runJobs(gradientWorker, batchStart, batchEnd);
+
+    double beta1Correction = 1.0 - pow(BETA1, step);
+    double beta2Correction = 1.0 - pow(BETA2, step);
+    int batchSize = batchEnd - batchStart;
+
+    for (int term = 0; term < NB_TERMS; term++) {
+        double gradient[2] = {0, 0};
+        for (int i = 0; i < tunerThreads; i++) {
+            gradient[middlegame] += jobs[i].gradient[term][middlegame];
+            gradient[endgame] += jobs[i].gradient[term][endgame];
+        }
+
+        // Tied terms are one weight used in both halves
+        if (tied[term])
+            gradient[middlegame] = gradient[endgame] = gradient[middlegame] + gradient[endgame];
+
+        for (int phase = middlegame; phase <= endgame; phase++) {
+            double g = gradient[phase] / batchSize;
+            momentum[term][phase] = BETA1 * momentum[term][phase] + (1.0 - BETA1) * g;
+            velocity[term][phase] = BETA2 * velocity[term][phase] + (1.0 - BETA2) * g * g;
+
+            double m = momentum[term][phase] / beta1Correction;
+            double v = velocity[term][phase] / beta2Correction;
+            params[term][phase] -= LEARNING_RATE * m / (sqrt(v) + EPSILON);
+        }
+    }
+
+    // The king's material has no effect, keep it at zero
+    params[KING][middlegame] = params[KING][endgame] = 0;
+}
+
+int main(int argc, char **argv) {
+    const char *dataPath = argc > 1 ? argv[1] : "data.txt";
+    const char *weightsIn = argc > 2 ? argv[2] : "weights.json";
+    const char *weightsOut = argc > 3 ? argv[3] : "new_weights.json";
+    int epochs = argc > 4 ? atoi(argv[4]) : 100;
+    tunerThreads = argc > 5 ? atoi(argv[5]) : 1;
+    int maxPositions = argc > 6 ? atoi(argv[6]) : 100000000;
+
+    tunerThreads = MAX(1, MIN(tunerThreads, MAX_THREADS));
+
+    initAttackMasks();
+    initZobristKeys();
+    initmagicmoves();
+    initPSQT();
+
+    initParams();
+    size_t length = strlen(dataPath);
+    if (length >= 4 && strcmp(dataPath + length - 4, ".bin") == 0) {
+        loadPackedPositions(dataPath, maxPositions);
+    } else {
+        loadPositions(dataPath, maxPositions);
+        shufflePositions();
+    }
+
+    printf("Loaded %d positions (%zu coefficients)\n", positionCount, poolSize);
+    if (mismatches)
+        printf("Warning: %d positions don't match the engine's evaluation\n", mismatches);
+    if (positionCount == 0)
+        return 1;
+
+    loadWeights(weightsIn);
+    computeOptimalK();
+
+    int step = 0;
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        for (int start = 0; start < positionCount; start += BATCH_SIZE)
+            adamStep(start, MIN(start + BATCH_SIZE, positionCount), ++step);
+
+        printf("Epoch %d error %.6f\n", epoch, meanSquaredError());
+        saveWeights(weightsOut);
+    }
+
+    printf("Saved weights to '%s'\n\n", weightsOut);
+    printWeights();
+    return 0;
+}